@@ -0,0 +1,98 @@
+//==--- ASTCache.h - Serialized ASTs of known sources ---------------------===//
+#ifndef __ASTCACHE_H
+#define __ASTCACHE_H
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+/// On-disk cache of parsed programs. An entry is named after the MD5 of
+/// the clang version and the source text, and consists of the source,
+/// <hash>.cc, and the serialized AST, <hash>.ast. The AST file records the
+/// source file's size and time stamp, so the source is kept next to it and
+/// the AST is parsed from it rather than from an in-memory buffer. A warm
+/// run deserializes the AST and skips lexing, parsing and Sema.
+class ASTCache {
+  std::string mDir;
+  std::shared_ptr<PCHContainerOperations> mPCHOperations;
+
+ public:
+  explicit ASTCache(llvm::StringRef dir)
+      : mDir(dir.str()),
+        mPCHOperations(std::make_shared<PCHContainerOperations>()) {}
+
+  /// The AST of code, loaded from the cache or parsed and then stored.
+  /// Returns NULL if the program could not be parsed at all.
+  std::unique_ptr<ASTUnit> load(llvm::StringRef code) {
+    std::string base = getEntryBase(code);
+    std::string sourcePath = base + ".cc";
+    std::string astPath = base + ".ast";
+
+    if (llvm::sys::fs::exists(astPath) && llvm::sys::fs::exists(sourcePath)) {
+      IntrusiveRefCntPtr<DiagnosticsEngine> diags =
+          CompilerInstance::createDiagnostics(new DiagnosticOptions());
+      std::unique_ptr<ASTUnit> unit = ASTUnit::LoadFromASTFile(
+          astPath, mPCHOperations->getRawReader(), ASTUnit::LoadEverything,
+          diags, FileSystemOptions());
+      if (unit) return unit;
+      // A stale or damaged entry is simply rebuilt below
+    }
+
+    if (std::error_code ec = llvm::sys::fs::create_directories(mDir)) {
+      llvm::errs() << "Cannot create AST cache " << mDir << ": "
+                   << ec.message() << "\n";
+      return tooling::buildASTFromCode(code);
+    }
+    std::error_code ec;
+    llvm::raw_fd_ostream source(sourcePath, ec);
+    if (ec) {
+      llvm::errs() << "Cannot write " << sourcePath << ": " << ec.message()
+                   << "\n";
+      return tooling::buildASTFromCode(code);
+    }
+    source << code;
+    source.close();
+
+    tooling::FixedCompilationDatabase compilations(".",
+                                                   std::vector<std::string>());
+    tooling::ClangTool tool(compilations,
+                            std::vector<std::string>(1, sourcePath));
+    std::vector<std::unique_ptr<ASTUnit>> units;
+    tool.buildASTs(units);
+    if (units.empty() || !units[0]) return NULL;
+    std::unique_ptr<ASTUnit> unit = std::move(units[0]);
+    // Programs with errors are not worth keeping; Save writes to a
+    // temporary file and renames it, so concurrent runs never see half an
+    // entry
+    if (!unit->getDiagnostics().hasErrorOccurred()) unit->Save(astPath);
+    return unit;
+  }
+
+ private:
+  std::string getEntryBase(llvm::StringRef code) {
+    llvm::MD5 hash;
+    hash.update(getClangFullVersion());
+    hash.update(code);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<128> path(mDir);
+    llvm::sys::path::append(path, result.digest().str());
+    return path.str().str();
+  }
+};
+
+#endif
@@ -3,7 +3,25 @@
 //===----------------------------------------------------------------------===//
 #include "ASTInterpreter.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ASTCache.h"
+#include "BytecodeCache.h"
+#include "BytecodeCompiler.h"
+#include "BytecodeVM.h"
 #include "Environment.h"
+#include "ForkServer.h"
+#include "PhaseTimer.h"
+#include "ProgramError.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/EvaluatedExprVisitor.h"
 #include "clang/AST/Expr.h"
@@ -13,16 +31,166 @@
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/thread.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 
 #include "Environment.h"
 
+enum EngineKind { AstEngine, BytecodeEngine };
+
+static llvm::cl::opt<EngineKind> Engine(
+    "engine", llvm::cl::desc("Execution engine"),
+    llvm::cl::values(
+        clEnumValN(AstEngine, "ast", "Walk the Clang AST (reference mode)"),
+        clEnumValN(BytecodeEngine, "vm",
+                   "Lower functions to register bytecode and run the VM")),
+    llvm::cl::init(AstEngine));
+
+static llvm::cl::opt<bool> DumpBytecode(
+    "dump-bytecode", llvm::cl::desc("Print the lowered bytecode to stdout"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> FoldCache(
+    "fold-cache",
+    llvm::cl::desc("Memoize constant folding of expressions (ast engine)"),
+    llvm::cl::init(true));
+
+static llvm::cl::opt<std::string> PrintTo(
+    "print-to",
+    llvm::cl::desc("Where PRINT writes: stderr, stdout or a file name"),
+    llvm::cl::value_desc("target"), llvm::cl::init("stderr"));
+
+static llvm::cl::opt<bool> Profile(
+    "profile",
+    llvm::cl::desc("Print per statement and function execution counts and "
+                   "times to stdout (ast engine)"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<std::string> Sample(
+    "sample",
+    llvm::cl::desc("Sample the interpreted call stack and write it to this "
+                   "file as collapsed stacks for flame graphs (ast engine)"),
+    llvm::cl::value_desc("file"), llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned> SampleHz(
+    "sample-hz", llvm::cl::desc("Samples per second of CPU time"),
+    llvm::cl::init(997));
+
+static llvm::cl::opt<bool> Memoize(
+    "memoize",
+    llvm::cl::desc("Cache the results of calls to functions that only "
+                   "depend on their arguments (ast engine)"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> StackBudget(
+    "stack-budget",
+    llvm::cl::desc("MiB that the frames of interpreted calls may take, "
+                   "which bounds the depth of recursion"),
+    llvm::cl::init(256));
+
+static llvm::cl::opt<bool> TimePhases(
+    "time-phases",
+    llvm::cl::desc("Print wall time, allocations and peak memory of the "
+                   "frontend, initialization, execution and flush to stdout"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> HeapStats(
+    "heap-stats", llvm::cl::desc("Print heap allocator counters to stdout"),
+    llvm::cl::init(false));
+
+#ifdef ENABLE_ORC_JIT
+static llvm::cl::opt<bool> JIT(
+    "jit", llvm::cl::desc("Compile hot functions with ORC LLJIT (ast engine)"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> JITThreshold(
+    "jit-threshold",
+    llvm::cl::desc("Calls after which a function is compiled natively"),
+    llvm::cl::init(100));
+#endif
+
+static llvm::cl::opt<std::string> ASTCacheDir(
+    "ast-cache",
+    llvm::cl::desc("Keep parsed programs in this directory and reuse them "
+                   "when the same source is run again"),
+    llvm::cl::value_desc("dir"), llvm::cl::init(""));
+
+static llvm::cl::opt<std::string> BytecodeCacheDir(
+    "bytecode-cache",
+    llvm::cl::desc("Keep compiled programs in this directory and run them "
+                   "without Clang when the same source is run again "
+                   "(vm engine)"),
+    llvm::cl::value_desc("dir"), llvm::cl::init(""));
+
+static llvm::cl::opt<std::string> Batch(
+    "batch",
+    llvm::cl::desc("Interpret every program listed in a manifest of "
+                   "'<source> [<input> [<output>]]' lines"),
+    llvm::cl::value_desc("manifest"), llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned> Jobs(
+    "jobs",
+    llvm::cl::desc("Programs interpreted in parallel in batch mode "
+                   "(0: one per core)"),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<bool> ForkServerMode(
+    "fork-server",
+    llvm::cl::desc("Initialize the program once, then run it on every "
+                   "'<input> [<output>]' request read from stdin in a "
+                   "forked copy"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<std::string> Code(llvm::cl::Positional,
+                                       llvm::cl::desc("<source code>"),
+                                       llvm::cl::init(""));
+
 void InterpreterVisitor::VisitBinaryOperator(BinaryOperator *bop) {
-  VisitStmt(bop);
+  if (bop->isLogicalOp()) {
+    // Only visit the RHS when the LHS does not decide the result
+    Expr *lhs = bop->getLHS();
+    Visit(lhs);
+    bool lhsVal = mEnv->getCond(lhs);
+    if (lhsVal == (bop->getOpcode() == BO_LAnd)) {
+      Expr *rhs = bop->getRHS();
+      Visit(rhs);
+      mEnv->logical(bop, mEnv->getCond(rhs));
+    } else {
+      mEnv->logical(bop, lhsVal);
+    }
+    return;
+  }
+  if (bop->isAssignmentOp()) {
+    visitLValue(bop->getLHS());
+    Visit(bop->getRHS());
+  } else {
+    VisitStmt(bop);
+  }
   mEnv->binop(bop);
 }
+void InterpreterVisitor::visitLValue(Expr *lvalue) {
+  lvalue = lvalue->IgnoreParens();
+  if (UnaryOperator *unaryOperator = dyn_cast<UnaryOperator>(lvalue)) {
+    if (unaryOperator->getOpcode() == UO_Deref) {
+      Visit(unaryOperator->getSubExpr());
+      return;
+    }
+  } else if (ArraySubscriptExpr *arraySubscriptExpr =
+                 dyn_cast<ArraySubscriptExpr>(lvalue)) {
+    Visit(arraySubscriptExpr->getBase());
+    Visit(arraySubscriptExpr->getIdx());
+    return;
+  }
+  // A variable needs no evaluation, anything else is rejected by
+  // Environment::lvalueAddr
+}
 void InterpreterVisitor::VisitDeclRefExpr(DeclRefExpr *expr) {
   VisitStmt(expr);
   mEnv->declref(expr);
@@ -57,12 +225,10 @@ void InterpreterVisitor::VisitForStmt(ForStmt *forStmt) {
     Expr *cond = forStmt->getCond();
     if (cond) {
       Visit(cond);
-      if (mEnv->getCond(cond)) {
-        Visit(forStmt->getBody());
-      } else {
-        break;
-      }
+      if (!mEnv->getCond(cond)) break;
     }
+    Visit(forStmt->getBody());
+    if (!continueLoop()) break;
     if (forStmt->getInc()) Visit(forStmt->getInc());
   }
 }
@@ -70,13 +236,33 @@ void InterpreterVisitor::VisitWhileStmt(WhileStmt *whileStmt) {
   while (true) {
     Expr *cond = whileStmt->getCond();
     Visit(cond);
-    if (mEnv->getCond(cond)) {
-      Visit(whileStmt->getBody());
-    } else {
-      break;
-    }
+    if (!mEnv->getCond(cond)) break;
+    Visit(whileStmt->getBody());
+    if (!continueLoop()) break;
+  }
+}
+bool InterpreterVisitor::continueLoop() {
+  // Loops whose body is a single statement never reach VisitCompoundStmt
+  mEnv->sample();
+  switch (mEnv->getControl()) {
+    case CF_Break:
+      mEnv->setControl(CF_Normal);
+      return false;
+    case CF_Continue:
+      mEnv->setControl(CF_Normal);
+      return true;
+    case CF_Return:
+      return false;
+    default:
+      return true;
   }
 }
+void InterpreterVisitor::VisitBreakStmt(BreakStmt *breakStmt) {
+  mEnv->setControl(CF_Break);
+}
+void InterpreterVisitor::VisitContinueStmt(ContinueStmt *continueStmt) {
+  mEnv->setControl(CF_Continue);
+}
 void InterpreterVisitor::VisitReturnStmt(ReturnStmt *returnStmt) {
   VisitStmt(returnStmt);
   mEnv->ret(returnStmt);
@@ -95,39 +281,400 @@ void InterpreterVisitor::VisitArraySubscriptExpr(
   VisitStmt(arraySubscriptExpr);
   mEnv->arraySubscriptExpr(arraySubscriptExpr);
 }
+void InterpreterVisitor::VisitConditionalOperator(
+    ConditionalOperator *condOperator) {
+  Expr *cond = condOperator->getCond();
+  Visit(cond);
+  Expr *chosen = mEnv->getCond(cond) ? condOperator->getTrueExpr()
+                                     : condOperator->getFalseExpr();
+  Visit(chosen);
+  mEnv->conditional(condOperator, chosen);
+}
+void InterpreterVisitor::VisitCompoundStmt(CompoundStmt *compoundStmt) {
+  StmtProfiler *profiler = mEnv->getProfiler();
+  for (Stmt *stmt : compoundStmt->body()) {
+    mEnv->sample();
+    if (profiler) {
+      StmtProfiler::Scope scope(*profiler, stmt);
+      Visit(stmt);
+    } else {
+      Visit(stmt);
+    }
+    // return, break and continue skip the rest of the block
+    if (mEnv->getControl() != CF_Normal) return;
+  }
+}
+
+/// Where one program reads GET input from and writes its output to
+struct ProgramRun {
+  /// PRINT target, see ProgramIO::setOutput
+  std::string printTo;
+  int inputFd;
+  /// Bytecode dumps, profiles and heap statistics
+  llvm::raw_ostream *report;
+  /// Serve GET inputs from stdin instead of running once, see ForkServer
+  bool forkServer;
+  /// Set to break the run into timed phases
+  PhaseTimer *phases;
+  /// Set to store the compiled program under this source in the bytecode
+  /// cache
+  const std::string *cacheSource;
+  /// Receives the message of the ProgramError that ended the program
+  std::string *error;
+};
+
+static void startPhase(const ProgramRun &run, const char *name) {
+  if (run.phases) run.phases->start(name);
+}
+static void countHeap(const ProgramRun &run, const Heap &heap) {
+  if (!run.phases) return;
+  const Heap::Stats &stats = heap.getStats();
+  run.phases->count("heap mallocs", stats.mallocs);
+  run.phases->count("heap peak live bytes", stats.peakLiveBytes);
+  run.phases->count("heap arena bytes", stats.arenaBytes);
+}
+static void openIO(const ProgramRun &run, ProgramIO &io) {
+  if (!io.setOutput(run.printTo))
+    throw ProgramError("Cannot open " + run.printTo + " for PRINT output");
+  io.setInput(run.inputFd);
+}
+
+/// Run one fork server request in the child. Its phases die with it, so it
+/// reports them itself, ahead of the status line the server prints.
+static void serveRequest(const ProgramRun &run,
+                         llvm::function_ref<void()> runEntry) {
+  if (run.phases) run.phases->reset();
+  runEntry();
+  if (run.phases) run.phases->printReport(*run.report);
+}
+
+static void runVM(const ProgramRun &run, BytecodeVM &vm) {
+  startPhase(run, "execute");
+  vm.runEntry();
+  startPhase(run, "flush");
+  vm.getIO().flush();
+  startPhase(run, "report");
+  countHeap(run, vm.getHeap());
+  if (HeapStats) vm.getHeap().printStats(*run.report);
+}
+
+/// Run a compiled program, fresh from the compiler or from the bytecode
+/// cache
+static void runModule(const BytecodeModule &module, const ProgramRun &run) {
+  if (DumpBytecode) dumpModule(module, *run.report);
+  startPhase(run, "init");
+  BytecodeVM vm(module);
+  vm.setStackBudget((size_t)StackBudget << 20);
+  try {
+    openIO(run, vm.getIO());
+    vm.initGlobals();
+    if (run.forkServer) {
+      ForkServer(vm.getIO()).serve(
+          [&] { serveRequest(run, [&] { runVM(run, vm); }); });
+    } else {
+      runVM(run, vm);
+    }
+  } catch (const ProgramError &error) {
+    vm.getIO().flush();
+    *run.error = error.what();
+  }
+  startPhase(run, "teardown");
+}
 
 class InterpreterConsumer : public ASTConsumer {
  public:
-  explicit InterpreterConsumer(const ASTContext &context)
-      : mEnv(context), mVisitor(context, &mEnv) {}
+  explicit InterpreterConsumer(const ASTContext &context,
+                               const ProgramRun &run)
+      : mRun(run), mEnv(context), mVisitor(context, &mEnv) {}
   virtual ~InterpreterConsumer() {}
 
   virtual void HandleTranslationUnit(clang::ASTContext &Context) {
-    TranslationUnitDecl *decl = Context.getTranslationUnitDecl();
+    try {
+      run(Context.getTranslationUnitDecl());
+    } catch (const ProgramError &error) {
+      mEnv.getIO().flush();
+      *mRun.error = error.what();
+    }
+    // Freeing the AST and the engine, finished by runProgram
+    startPhase("teardown");
+  }
+
+ private:
+  void startPhase(const char *name) { ::startPhase(mRun, name); }
+
+  void run(TranslationUnitDecl *decl) {
+    if (Engine == BytecodeEngine) {
+      startPhase("compile");
+      BytecodeModule module;
+      BytecodeCompiler(decl->getASTContext()).compile(decl, module);
+      if (mRun.cacheSource)
+        BytecodeCache(BytecodeCacheDir).store(*mRun.cacheSource, module);
+      runModule(module, mRun);
+      return;
+    }
+    startPhase("init");
+    openIO(mRun, mEnv.getIO());
+    mEnv.getConstants().setEnabled(FoldCache);
     mEnv.init(decl, &mVisitor);
+#ifdef ENABLE_ORC_JIT
+    if (JIT) mEnv.enableJIT(JITThreshold);
+#endif
+    if (Profile) mEnv.enableProfiler();
+    if (Memoize) mEnv.enableMemoizer(decl);
+    if (!Sample.empty()) mEnv.enableSampler(SampleHz);
 
-    FunctionDecl *entry = mEnv.getEntry();
-    mVisitor.VisitStmt(entry->getBody());
+    if (mRun.forkServer) {
+      ForkServer(mEnv.getIO()).serve(
+          [&] { serveRequest(mRun, [&] { runEntry(); }); });
+    } else {
+      runEntry();
+    }
   }
 
- private:
+  /// Run main on the initialized environment and write the reports
+  void runEntry() {
+    startPhase("execute");
+    FunctionDecl *entry = mEnv.getEntry();
+    if (StmtProfiler *profiler = mEnv.getProfiler()) {
+      StmtProfiler::Scope scope(*profiler, entry);
+      mVisitor.Visit(entry->getBody());
+    } else {
+      mVisitor.Visit(entry->getBody());
+    }
+    startPhase("flush");
+    mEnv.getIO().flush();
+    startPhase("report");
+    countHeap(mRun, mEnv.getHeap());
+    if (Profile) {
+      mEnv.getProfiler()->printReport(*mRun.report);
+      if (MemoCache *memo = mEnv.getMemoCache())
+        memo->printStats(*mRun.report);
+#ifdef ENABLE_ORC_JIT
+      if (TierUpJIT *jit = mEnv.getJIT()) jit->printStats(*mRun.report);
+#endif
+    }
+    if (HeapStats) mEnv.getHeap().printStats(*mRun.report);
+    if (StackSampler *sampler = mEnv.getSampler()) {
+      std::error_code ec;
+      llvm::raw_fd_ostream samples(Sample, ec);
+      if (ec)
+        throw ProgramError("Cannot write " + Sample + ": " + ec.message());
+      sampler->writeCollapsed(samples);
+    }
+  }
+  const ProgramRun &mRun;
   Environment mEnv;
   InterpreterVisitor mVisitor;
 };
 
 class InterpreterClassAction : public ASTFrontendAction {
  public:
+  explicit InterpreterClassAction(const ProgramRun &run) : mRun(run) {}
   virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
       clang::CompilerInstance &Compiler, llvm::StringRef InFile) {
     return std::unique_ptr<clang::ASTConsumer>(
-        new InterpreterConsumer(Compiler.getASTContext()));
+        new InterpreterConsumer(Compiler.getASTContext(), mRun));
   }
+
+ private:
+  const ProgramRun &mRun;
 };
 
-int main(int argc, char **argv) {
-  if (argc > 1) {
+/// Parse code, through the AST cache if there is one, and interpret it.
+/// A program found in the bytecode cache runs without Clang.
+static void runProgram(
+    const std::string &code, const ProgramRun &cold,
+    std::shared_ptr<PCHContainerOperations> pchOperations) {
+  ProgramRun run = cold;
+  if (Engine == BytecodeEngine && !BytecodeCacheDir.empty()) {
+    startPhase(run, "load");
+    BytecodeModule module;
+    if (BytecodeCache(BytecodeCacheDir).load(code, module)) {
+      runModule(module, run);
+      if (run.phases) run.phases->finish();
+      return;
+    }
+    run.cacheSource = &code;
+  }
+  // Lexing, parsing and Sema, or loading the cached AST
+  if (run.phases) run.phases->start("frontend");
+  if (!ASTCacheDir.empty()) {
+    std::unique_ptr<ASTUnit> unit = ASTCache(ASTCacheDir).load(code);
+    if (!unit) {
+      *run.error = "Failed to parse the program";
+      return;
+    }
+    ASTContext &context = unit->getASTContext();
+    InterpreterConsumer consumer(context, run);
+    consumer.HandleTranslationUnit(context);
+  } else {
     clang::tooling::runToolOnCode(
-        std::unique_ptr<clang::FrontendAction>(new InterpreterClassAction),
-        argv[1]);
+        std::unique_ptr<clang::FrontendAction>(new InterpreterClassAction(run)),
+        code, "input.cc", pchOperations);
+  }
+  if (run.phases) run.phases->finish();
+}
+
+/// One line of a batch manifest
+struct BatchJob {
+  std::string source;
+  std::string input;
+  std::string output;
+  std::string report;
+  double millis;
+  bool failed;
+};
+
+/// Read a manifest of "<source> [<input> [<output>]]" lines. Paths are
+/// relative to the manifest, the output defaults to <source>.out, and
+/// blank lines and lines starting with '#' are skipped.
+static std::vector<BatchJob> readManifest(llvm::StringRef manifest) {
+  auto buffer = llvm::MemoryBuffer::getFile(manifest);
+  if (!buffer) {
+    llvm::errs() << "Cannot read manifest " << manifest << "\n";
+    exit(-1);
+  }
+  llvm::StringRef dir = llvm::sys::path::parent_path(manifest);
+  auto resolve = [&](llvm::StringRef path) {
+    llvm::SmallString<256> resolved(path);
+    if (llvm::sys::path::is_relative(path) && !dir.empty()) {
+      resolved = dir;
+      llvm::sys::path::append(resolved, path);
+    }
+    return resolved.str().str();
+  };
+  std::vector<BatchJob> jobs;
+  llvm::SmallVector<llvm::StringRef, 16> lines;
+  (*buffer)->getBuffer().split(lines, '\n');
+  for (llvm::StringRef line : lines) {
+    line = line.trim();
+    if (line.empty() || line.startswith("#")) continue;
+    llvm::SmallVector<llvm::StringRef, 3> fields;
+    line.split(fields, ' ', -1, false);
+    BatchJob job;
+    job.source = resolve(fields[0]);
+    if (fields.size() > 1) job.input = resolve(fields[1]);
+    job.output =
+        fields.size() > 2 ? resolve(fields[2]) : job.source + ".out";
+    job.millis = 0;
+    job.failed = false;
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+/// Stack size of the threads that interpret, see main. llvm::thread takes
+/// an unsigned size, so budgets of 4 GiB and more are capped.
+static llvm::Optional<unsigned> getInterpreterStackSize() {
+  return (unsigned)std::min<size_t>((size_t)StackBudget << 20, 4095u << 20);
+}
+
+/// Run one job of a batch. Its errors end up in its report, the other
+/// jobs carry on.
+static void runBatchJob(BatchJob &job,
+                        std::shared_ptr<PCHContainerOperations> pchOperations) {
+  llvm::raw_string_ostream report(job.report);
+  auto code = llvm::MemoryBuffer::getFile(job.source);
+  if (!code) {
+    report << "error: Cannot read " << job.source << "\n";
+    job.failed = true;
+    return;
+  }
+  const char *input = job.input.empty() ? "/dev/null" : job.input.c_str();
+  int inputFd = open(input, O_RDONLY);
+  if (inputFd < 0) {
+    report << "error: Cannot read " << input << "\n";
+    job.failed = true;
+    return;
+  }
+  std::string error;
+  ProgramRun run = {job.output, inputFd, &report, false, NULL, NULL, &error};
+  auto start = std::chrono::steady_clock::now();
+  runProgram((*code)->getBuffer().str(), run, pchOperations);
+  job.millis = std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  if (!error.empty()) {
+    report << "error: " << error << "\n";
+    job.failed = true;
+  }
+  close(inputFd);
+}
+
+/// Interpret the programs of a manifest in one process on worker threads.
+/// Each program gets its own Environment or VM, heap, input and output,
+/// and its own CompilerInstance: only the process, its loaded code and
+/// the PCHContainerOperations are shared. Reports are printed in manifest
+/// order once every program finished. Returns the number of programs that
+/// failed.
+static unsigned runBatch(llvm::StringRef manifest, unsigned numThreads) {
+  std::vector<BatchJob> jobs = readManifest(manifest);
+  auto pchOperations = std::make_shared<PCHContainerOperations>();
+  // Not an llvm::ThreadPool: its threads have the default stack, and the
+  // AST engine needs one as large as --stack-budget
+  std::atomic<size_t> next(0);
+  auto work = [&] {
+    for (size_t i = next++; i < jobs.size(); i = next++) {
+      runBatchJob(jobs[i], pchOperations);
+    }
+  };
+  unsigned numWorkers =
+      llvm::hardware_concurrency(numThreads).compute_thread_count();
+  numWorkers = std::max<size_t>(1, std::min<size_t>(numWorkers, jobs.size()));
+  std::vector<llvm::thread> workers;
+  for (unsigned i = 0; i < numWorkers; i++) {
+    workers.emplace_back(getInterpreterStackSize(), work);
+  }
+  for (llvm::thread &worker : workers) worker.join();
+  unsigned numFailed = 0;
+  for (const BatchJob &job : jobs) {
+    llvm::outs() << job.source << " -> " << job.output << " "
+                 << llvm::format("%.3f", job.millis) << " ms\n"
+                 << job.report;
+    numFailed += job.failed;
+  }
+  return numFailed;
+}
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(argc, argv, "Clang AST interpreter\n");
+  if (!Batch.empty()) {
+    // The sampler's timer, signal handler and output file are process wide,
+    // and so are the counters behind --time-phases; the fork server reads
+    // its requests from the one stdin
+    const char *single = !Sample.empty()  ? "--sample"
+                         : TimePhases     ? "--time-phases"
+                         : ForkServerMode ? "--fork-server"
+                                          : NULL;
+    if (single) {
+      llvm::errs() << single << " runs a single program and cannot be "
+                   << "combined with --batch\n";
+      exit(-1);
+    }
+    return runBatch(Batch, Jobs) ? 1 : 0;
+  }
+  if (Code.empty()) return 0;
+  PhaseTimer phases;
+  std::string error;
+  ProgramRun run = {PrintTo, STDIN_FILENO, &llvm::outs(), ForkServerMode,
+                    TimePhases ? &phases : NULL, NULL, &error};
+  if (!Sample.empty()) {
+    // SIGPROF has to reach the interpreting thread, which unblocks it
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+  }
+  // The AST engine still recurses natively once per interpreted call, so
+  // it gets a stack as large as the budget; the VM keeps its frames on an
+  // explicit stack and checks the budget itself
+  llvm::thread interpreter(getInterpreterStackSize(), [&run] {
+    runProgram(Code, run, std::make_shared<PCHContainerOperations>());
+  });
+  interpreter.join();
+  if (!error.empty()) {
+    llvm::errs() << error << "\n";
+    exit(-1);
   }
+  if (TimePhases) phases.printReport(llvm::outs());
 }
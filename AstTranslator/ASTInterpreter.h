@@ -37,7 +37,18 @@ public:
   virtual void VisitUnaryExprOrTypeTraitExpr(UnaryExprOrTypeTraitExpr* unaryExprOrTypeTraitExpr);
   virtual void VisitParenExpr(ParenExpr* parenExpr);
   virtual void VisitArraySubscriptExpr(ArraySubscriptExpr* arraySubscriptExpr);
+  virtual void VisitCompoundStmt(CompoundStmt* compoundStmt);
+  virtual void VisitConditionalOperator(ConditionalOperator* condOperator);
+  virtual void VisitBreakStmt(BreakStmt* breakStmt);
+  virtual void VisitContinueStmt(ContinueStmt* continueStmt);
 private:
+  /// Evaluate the operands of an assignment target but not the target
+  /// itself, so no value is loaded from where the store goes
+  void visitLValue(Expr* lvalue);
+  /// Consume a break or continue left by a loop body and tell whether the
+  /// loop goes on
+  bool continueLoop();
+
   Environment *mEnv;
 };
 
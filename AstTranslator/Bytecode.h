@@ -0,0 +1,106 @@
+//==--- Bytecode.h - Register bytecode of the vm engine -------------------===//
+#ifndef __BYTECODE_H
+#define __BYTECODE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/raw_ostream.h"
+
+/// Register bytecode executed by BytecodeVM.
+///
+/// Every instruction has the same fixed layout: an opcode and three 32-bit
+/// operands. Operands name frame registers, global slots, function indices,
+/// jump targets or immediates depending on the opcode (see the table below).
+/// Values are ints, addresses are Heap byte offsets, exactly as in
+/// Environment.
+enum Opcode : uint8_t {
+  OP_LOADK,   ///< r[a] = b
+  OP_MOV,     ///< r[a] = r[b]
+  OP_LOADG,   ///< r[a] = globals[b]
+  OP_STOREG,  ///< globals[a] = r[b]
+  OP_ADD,     ///< r[a] = r[b] + r[c]
+  OP_SUB,     ///< r[a] = r[b] - r[c]
+  OP_MUL,     ///< r[a] = r[b] * r[c]
+  OP_DIV,     ///< r[a] = r[b] / r[c]
+  OP_REM,     ///< r[a] = r[b] % r[c]
+  OP_LT,      ///< r[a] = r[b] < r[c]
+  OP_GT,      ///< r[a] = r[b] > r[c]
+  OP_LE,      ///< r[a] = r[b] <= r[c]
+  OP_GE,      ///< r[a] = r[b] >= r[c]
+  OP_EQ,      ///< r[a] = r[b] == r[c]
+  OP_NE,      ///< r[a] = r[b] != r[c]
+  OP_NEG,     ///< r[a] = -r[b]
+  OP_NOT,     ///< r[a] = !r[b]
+  OP_TRUNC,   ///< r[a] = r[b] wrapped to the integer type of access code c
+  OP_LOAD,    ///< r[a] = heap[r[b]], c is the Heap access code
+  OP_STORE,   ///< heap[r[a]] = r[b], c is the Heap access code
+  OP_JMP,     ///< pc = a
+  OP_JZ,      ///< if (!r[a]) pc = b
+  OP_JNZ,     ///< if (r[a]) pc = b
+  OP_CALL,    ///< r[a] = functions[b](r[c], r[c + 1], ...)
+  OP_RET,     ///< return r[a]
+  OP_RETV,    ///< return 0
+  OP_GET,     ///< r[a] = GET()
+  OP_PRINT,   ///< PRINT(r[a])
+  OP_MALLOC,  ///< r[a] = MALLOC(r[b])
+  OP_FREE,    ///< FREE(r[a])
+  OP_ALLOCA,  ///< r[a] = b zeroed bytes, freed when the function returns
+  OP_NUM_OPCODES
+};
+
+struct Instr {
+  uint8_t op;
+  int32_t a;
+  int32_t b;
+  int32_t c;
+  Instr() : op(OP_RETV), a(0), b(0), c(0) {}
+  Instr(uint8_t _op, int32_t _a = 0, int32_t _b = 0, int32_t _c = 0)
+      : op(_op), a(_a), b(_b), c(_c) {}
+};
+
+/// One lowered FunctionDecl. Parameters occupy registers [0, numParams),
+/// locals and temporaries follow up to numRegs.
+struct BytecodeFunction {
+  std::string name;
+  unsigned numParams;
+  unsigned numRegs;
+  std::vector<Instr> code;
+  BytecodeFunction() : numParams(0), numRegs(0) {}
+};
+
+/// A whole lowered translation unit. globalInit is a parameterless function
+/// that runs the global initializers before entry is called.
+struct BytecodeModule {
+  std::vector<BytecodeFunction> functions;
+  unsigned numGlobals;
+  int globalInit;
+  int entry;
+  BytecodeModule() : numGlobals(0), globalInit(-1), entry(-1) {}
+};
+
+inline const char* getOpcodeName(uint8_t op) {
+  static const char* names[] = {
+      "loadk", "mov", "loadg",  "storeg", "add",    "sub",  "mul",  "div",
+      "rem",   "lt",   "gt",    "le",     "ge",   "eq",    "ne",  "neg",
+      "not",   "trunc", "load", "store",  "jmp",  "jz",    "jnz", "call",
+      "ret",   "retv", "get",   "print",  "malloc", "free", "alloca"};
+  static_assert(sizeof(names) / sizeof(names[0]) == OP_NUM_OPCODES,
+                "opcode name table out of sync");
+  return op < OP_NUM_OPCODES ? names[op] : "<bad>";
+}
+
+inline void dumpModule(const BytecodeModule& module, llvm::raw_ostream& os) {
+  for (unsigned f = 0; f < module.functions.size(); f++) {
+    const BytecodeFunction& fn = module.functions[f];
+    os << "function " << f << " " << fn.name << " (params " << fn.numParams
+       << ", regs " << fn.numRegs << ")\n";
+    for (unsigned pc = 0; pc < fn.code.size(); pc++) {
+      const Instr& ins = fn.code[pc];
+      os << "  " << pc << ": " << getOpcodeName(ins.op) << " " << ins.a << " "
+         << ins.b << " " << ins.c << "\n";
+    }
+  }
+}
+
+#endif
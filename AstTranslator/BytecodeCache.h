@@ -0,0 +1,254 @@
+//==--- BytecodeCache.h - On-disk cache of compiled bytecode --------------===//
+#ifndef __BYTECODECACHE_H
+#define __BYTECODECACHE_H
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "Bytecode.h"
+#include "clang/Basic/Version.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// On-disk cache of lowered programs, so a warm run of a known source
+/// skips Clang altogether. An entry is named after the MD5 of the clang
+/// version, the bytecode format, the instruction set and the source text,
+/// and holds the whole BytecodeModule: call targets resolved to function
+/// indices, register counts from the slot layout and constants folded into
+/// loadk operands.
+///
+/// The entry is mapped read-only (small ones are simply read), and every
+/// operand is checked against the sizes of its function and module before
+/// the VM gets to run it. Its layout is a header of int32s (magic, format,
+/// number of functions, globals, global initializer and entry), then per
+/// function its name length, parameters, registers and instruction count,
+/// the name padded to four bytes and four int32s (op, a, b, c) per
+/// instruction.
+class BytecodeCache {
+  /// Bump whenever the compiler emits different code for the same source.
+  /// Changes to the opcodes or to Instr change the key by themselves.
+  static const int32_t kFormat = 2;
+  static const int32_t kMagic = 0x43425341;  // "ASBC"
+
+  std::string mDir;
+
+ public:
+  explicit BytecodeCache(llvm::StringRef dir) : mDir(dir.str()) {}
+
+  /// Fill module from the entry for code. Returns false on a miss or a
+  /// damaged entry.
+  bool load(llvm::StringRef code, BytecodeModule& module) {
+    auto buffer = llvm::MemoryBuffer::getFile(
+        getEntryPath(code), /*IsText=*/false,
+        /*RequiresNullTerminator=*/false);
+    if (!buffer) return false;
+    Reader reader((*buffer)->getBufferStart(), (*buffer)->getBufferSize());
+    int32_t magic, format, numFunctions, numGlobals;
+    if (!reader.read(magic) || magic != kMagic || !reader.read(format) ||
+        format != kFormat || !reader.read(numFunctions) ||
+        !reader.read(numGlobals) || !reader.read(module.globalInit) ||
+        !reader.read(module.entry) || numFunctions < 0 || numGlobals < 0)
+      return false;
+    module.numGlobals = numGlobals;
+    module.functions.resize(numFunctions);
+    for (BytecodeFunction& fn : module.functions) {
+      int32_t nameLen, numParams, numRegs, codeSize;
+      if (!reader.read(nameLen) || !reader.read(numParams) ||
+          !reader.read(numRegs) || !reader.read(codeSize) || nameLen < 0 ||
+          numParams < 0 || numRegs < numParams || codeSize <= 0)
+        return false;
+      const char* name = reader.take((nameLen + 3) & ~3);
+      if (!name) return false;
+      fn.name.assign(name, nameLen);
+      fn.numParams = numParams;
+      fn.numRegs = numRegs;
+      const char* words =
+          reader.take((size_t)codeSize * 4 * sizeof(int32_t));
+      if (!words) return false;
+      fn.code.resize(codeSize);
+      for (Instr& ins : fn.code) {
+        int32_t fields[4];
+        std::memcpy(fields, words, sizeof(fields));
+        words += sizeof(fields);
+        if (fields[0] < 0 || fields[0] >= OP_NUM_OPCODES) return false;
+        ins = Instr(fields[0], fields[1], fields[2], fields[3]);
+      }
+    }
+    if (module.entry < 0 || module.entry >= numFunctions ||
+        module.globalInit < 0 || module.globalInit >= numFunctions ||
+        module.functions[module.globalInit].numParams != 0)
+      return false;
+    for (const BytecodeFunction& fn : module.functions) {
+      if (!verify(module, fn)) return false;
+    }
+    return true;
+  }
+
+  /// Write the entry for code. Failures only cost the next run its warm
+  /// start, so they are reported and otherwise ignored.
+  void store(llvm::StringRef code, const BytecodeModule& module) {
+    if (std::error_code ec = llvm::sys::fs::create_directories(mDir)) {
+      llvm::errs() << "Cannot create bytecode cache " << mDir << ": "
+                   << ec.message() << "\n";
+      return;
+    }
+    std::string path = getEntryPath(code);
+    // Write to a unique file and rename it, so concurrent runs never map
+    // half an entry
+    int fd;
+    llvm::SmallString<128> tempPath;
+    if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%", fd, tempPath)) {
+      llvm::errs() << "Cannot write " << path << "\n";
+      return;
+    }
+    {
+      llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+      write(os, kMagic);
+      write(os, kFormat);
+      write(os, (int32_t)module.functions.size());
+      write(os, (int32_t)module.numGlobals);
+      write(os, (int32_t)module.globalInit);
+      write(os, (int32_t)module.entry);
+      for (const BytecodeFunction& fn : module.functions) {
+        write(os, (int32_t)fn.name.size());
+        write(os, (int32_t)fn.numParams);
+        write(os, (int32_t)fn.numRegs);
+        write(os, (int32_t)fn.code.size());
+        os << fn.name;
+        os.write_zeros(((fn.name.size() + 3) & ~3) - fn.name.size());
+        for (const Instr& ins : fn.code) {
+          write(os, (int32_t)ins.op);
+          write(os, ins.a);
+          write(os, ins.b);
+          write(os, ins.c);
+        }
+      }
+    }
+    if (llvm::sys::fs::rename(tempPath, path))
+      llvm::sys::fs::remove(tempPath);
+  }
+
+ private:
+  /// Bounds checked cursor over the mapped entry
+  class Reader {
+    const char* mPos;
+    const char* mEnd;
+
+   public:
+    Reader(const char* start, size_t size)
+        : mPos(start), mEnd(start + size) {}
+    const char* take(size_t bytes) {
+      if ((size_t)(mEnd - mPos) < bytes) return NULL;
+      const char* start = mPos;
+      mPos += bytes;
+      return start;
+    }
+    bool read(int32_t& val) {
+      const char* bytes = take(sizeof(val));
+      if (!bytes) return false;
+      std::memcpy(&val, bytes, sizeof(val));
+      return true;
+    }
+  };
+
+  /// Whether every operand of fn stays inside its registers, its code, the
+  /// globals and the functions of module, and fn cannot run off its end
+  static bool verify(const BytecodeModule& module,
+                     const BytecodeFunction& fn) {
+    int64_t numRegs = fn.numRegs;
+    int64_t codeSize = fn.code.size();
+    auto reg = [&](int32_t r) { return r >= 0 && r < numRegs; };
+    auto target = [&](int32_t pc) { return pc >= 0 && pc < codeSize; };
+    auto global = [&](int32_t g) {
+      return g >= 0 && (uint32_t)g < module.numGlobals;
+    };
+    auto access = [](int32_t c) {
+      int32_t width = c < 0 ? -c : c;
+      return width == 1 || width == 2 || width == 4 || width == 8;
+    };
+    for (const Instr& ins : fn.code) {
+      bool ok;
+      switch (ins.op) {
+        case OP_LOADK:
+        case OP_GET:
+        case OP_PRINT:
+        case OP_FREE:
+        case OP_RET:
+          ok = reg(ins.a);
+          break;
+        case OP_MOV:
+        case OP_NEG:
+        case OP_NOT:
+        case OP_MALLOC:
+          ok = reg(ins.a) && reg(ins.b);
+          break;
+        case OP_LOADG:
+          ok = reg(ins.a) && global(ins.b);
+          break;
+        case OP_STOREG:
+          ok = global(ins.a) && reg(ins.b);
+          break;
+        case OP_TRUNC:
+        case OP_LOAD:
+        case OP_STORE:
+          ok = reg(ins.a) && reg(ins.b) && access(ins.c);
+          break;
+        case OP_JMP:
+          ok = target(ins.a);
+          break;
+        case OP_JZ:
+        case OP_JNZ:
+          ok = reg(ins.a) && target(ins.b);
+          break;
+        case OP_CALL: {
+          if (!reg(ins.a) || ins.b < 0 ||
+              (size_t)ins.b >= module.functions.size())
+            return false;
+          int64_t numArgs = module.functions[ins.b].numParams;
+          ok = numArgs == 0 || (reg(ins.c) && ins.c + numArgs <= numRegs);
+          break;
+        }
+        case OP_RETV:
+          ok = true;
+          break;
+        case OP_ALLOCA:
+          ok = reg(ins.a) && ins.b >= 0;
+          break;
+        default:
+          // The binary operators
+          ok = reg(ins.a) && reg(ins.b) && reg(ins.c);
+      }
+      if (!ok) return false;
+    }
+    uint8_t last = fn.code.back().op;
+    return last == OP_RET || last == OP_RETV || last == OP_JMP;
+  }
+
+  static void write(llvm::raw_ostream& os, int32_t val) {
+    os.write(reinterpret_cast<const char*>(&val), sizeof(val));
+  }
+
+  std::string getEntryPath(llvm::StringRef code) {
+    llvm::MD5 hash;
+    hash.update(clang::getClangFullVersion());
+    hash.update(std::to_string(kFormat));
+    hash.update(std::to_string(sizeof(Instr)));
+    for (unsigned op = 0; op < OP_NUM_OPCODES; op++) {
+      hash.update(getOpcodeName(op));
+      hash.update(",");
+    }
+    hash.update(code);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<128> path(mDir);
+    llvm::sys::path::append(path, result.digest().str() + ".bc");
+    return path.str().str();
+  }
+};
+
+#endif
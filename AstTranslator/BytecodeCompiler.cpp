@@ -0,0 +1,510 @@
+//==--- BytecodeCompiler.cpp - Lowering of the AST to bytecode ------------===//
+#include "BytecodeCompiler.h"
+
+#include "ProgramError.h"
+#include "clang/AST/Type.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/raw_ostream.h"
+
+void BytecodeCompiler::compile(TranslationUnitDecl* unit,
+                               BytecodeModule& module) {
+  mModule = &module;
+  mLayout.build(unit);
+  std::vector<FunctionDecl*> definitions;
+  std::vector<VarDecl*> globals;
+  for (TranslationUnitDecl::decl_iterator i = unit->decls_begin(),
+                                          e = unit->decls_end();
+       i != e; ++i) {
+    if (FunctionDecl* fdecl = dyn_cast<FunctionDecl>(*i)) {
+      if (fdecl->getName().equals("FREE"))
+        mFree = fdecl->getCanonicalDecl();
+      else if (fdecl->getName().equals("MALLOC"))
+        mMalloc = fdecl->getCanonicalDecl();
+      else if (fdecl->getName().equals("GET"))
+        mInput = fdecl->getCanonicalDecl();
+      else if (fdecl->getName().equals("PRINT"))
+        mOutput = fdecl->getCanonicalDecl();
+      else if (fdecl->isThisDeclarationADefinition()) {
+        mFunctions[fdecl->getCanonicalDecl()] = definitions.size();
+        if (fdecl->getName().equals("main")) module.entry = definitions.size();
+        definitions.push_back(fdecl);
+      }
+    } else if (VarDecl* vdecl = dyn_cast<VarDecl>(*i)) {
+      globals.push_back(vdecl);
+    }
+  }
+
+  module.numGlobals = mLayout.getNumGlobals();
+  module.functions.resize(definitions.size() + 1);
+  for (unsigned i = 0; i < definitions.size(); i++) {
+    compileFunction(definitions[i], module.functions[i]);
+  }
+  module.globalInit = definitions.size();
+  compileGlobalInit(globals, module.functions[module.globalInit]);
+}
+
+void BytecodeCompiler::compileFunction(FunctionDecl* fdecl,
+                                       BytecodeFunction& fn) {
+  mFn = &fn;
+  mLoops.clear();
+  fn.name = fdecl->getNameAsString();
+  fn.numParams = fdecl->getNumParams();
+  // Parameters and locals own the registers of their slots, temporaries
+  // start above them and are recycled after every statement. The address
+  // of the local array block takes the first register above the slots.
+  mNextReg = mLayout.getFrameSize(fdecl);
+  fn.numRegs = mNextReg;
+  mArrayBase = -1;
+  if (unsigned arrayBytes = mLayout.getArrayBytes(fdecl)) {
+    mArrayBase = newTemp();
+    emit(OP_ALLOCA, mArrayBase, arrayBytes);
+  }
+  compileStmt(fdecl->getBody());
+  emit(OP_RETV);
+}
+
+void BytecodeCompiler::compileGlobalInit(const std::vector<VarDecl*>& globals,
+                                         BytecodeFunction& fn) {
+  mFn = &fn;
+  mLoops.clear();
+  fn.name = "<global-init>";
+  mNextReg = 0;
+  for (VarDecl* vdecl : globals) {
+    int saved = mNextReg;
+    VarSlot slot;
+    mLayout.lookup(vdecl, slot);
+    if (isa<ConstantArrayType>(vdecl->getType().getTypePtr())) {
+      int size = newTemp();
+      int addr = newTemp();
+      emit(OP_LOADK, size, getAllocSize(mContext, vdecl->getType()));
+      emit(OP_MALLOC, addr, size);
+      emit(OP_STOREG, slot.index, addr);
+    } else if (vdecl->hasInit()) {
+      int val = compileExpr(vdecl->getInit());
+      emit(OP_STOREG, slot.index, val);
+    }
+    mNextReg = saved;
+  }
+  emit(OP_RETV);
+}
+
+void BytecodeCompiler::compileStmt(Stmt* stmt) {
+  if (!stmt) return;
+  int saved = mNextReg;
+  if (CompoundStmt* compound = dyn_cast<CompoundStmt>(stmt)) {
+    for (Stmt* child : compound->body()) compileStmt(child);
+  } else if (DeclStmt* declstmt = dyn_cast<DeclStmt>(stmt)) {
+    compileDecl(declstmt);
+  } else if (IfStmt* ifstmt = dyn_cast<IfStmt>(stmt)) {
+    compileIf(ifstmt);
+  } else if (WhileStmt* whileStmt = dyn_cast<WhileStmt>(stmt)) {
+    compileWhile(whileStmt);
+  } else if (DoStmt* doStmt = dyn_cast<DoStmt>(stmt)) {
+    compileDo(doStmt);
+  } else if (ForStmt* forStmt = dyn_cast<ForStmt>(stmt)) {
+    compileFor(forStmt);
+  } else if (ReturnStmt* returnStmt = dyn_cast<ReturnStmt>(stmt)) {
+    if (Expr* expr = returnStmt->getRetValue()) {
+      emit(OP_RET, compileExpr(expr));
+    } else {
+      emit(OP_RETV);
+    }
+  } else if (isa<BreakStmt>(stmt)) {
+    if (mLoops.empty()) unsupported(stmt, "break outside of loop");
+    mLoops.back().breaks.push_back(emit(OP_JMP));
+  } else if (isa<ContinueStmt>(stmt)) {
+    if (mLoops.empty()) unsupported(stmt, "continue outside of loop");
+    mLoops.back().continues.push_back(emit(OP_JMP));
+  } else if (isa<NullStmt>(stmt)) {
+    // Nothing to do
+  } else if (Expr* expr = dyn_cast<Expr>(stmt)) {
+    compileExpr(expr);
+  } else {
+    unsupported(stmt, "statement");
+  }
+  mNextReg = saved;
+}
+
+void BytecodeCompiler::compileDecl(DeclStmt* declstmt) {
+  for (DeclStmt::decl_iterator it = declstmt->decl_begin(),
+                               ie = declstmt->decl_end();
+       it != ie; ++it) {
+    VarDecl* vardecl = dyn_cast<VarDecl>(*it);
+    VarSlot slot;
+    if (!vardecl || !mLayout.lookup(vardecl, slot)) continue;
+    int reg = slot.index;
+    if (isa<ConstantArrayType>(vardecl->getType().getTypePtr())) {
+      int offset = newTemp();
+      emit(OP_LOADK, offset, slot.arrayOffset);
+      emit(OP_ADD, reg, mArrayBase, offset);
+    } else if (vardecl->hasInit()) {
+      compileExpr(vardecl->getInit(), reg);
+    } else {
+      emit(OP_LOADK, reg, 0);
+    }
+  }
+}
+
+int BytecodeCompiler::compileCond(Expr* cond) {
+  cond = cond->IgnoreParens();
+  if (CastExpr* castexpr = dyn_cast<CastExpr>(cond)) {
+    int access;
+    if (getCastConversion(mContext, castexpr, access) == CastToBool)
+      cond = castexpr->getSubExpr();
+  }
+  return compileExpr(cond);
+}
+
+void BytecodeCompiler::compileIf(IfStmt* ifstmt) {
+  int cond = compileCond(ifstmt->getCond());
+  int skipThen = emit(OP_JZ, cond);
+  compileStmt(ifstmt->getThen());
+  if (Stmt* elseStmt = ifstmt->getElse()) {
+    int skipElse = emit(OP_JMP);
+    patch(skipThen, here());
+    compileStmt(elseStmt);
+    patch(skipElse, here());
+  } else {
+    patch(skipThen, here());
+  }
+}
+
+void BytecodeCompiler::compileWhile(WhileStmt* whileStmt) {
+  int top = here();
+  int saved = mNextReg;
+  int cond = compileCond(whileStmt->getCond());
+  mNextReg = saved;
+  int exitJump = emit(OP_JZ, cond);
+  mLoops.push_back(LoopContext());
+  compileStmt(whileStmt->getBody());
+  emit(OP_JMP, top);
+  patch(exitJump, here());
+  for (int at : mLoops.back().breaks) patch(at, here());
+  for (int at : mLoops.back().continues) patch(at, top);
+  mLoops.pop_back();
+}
+
+void BytecodeCompiler::compileDo(DoStmt* doStmt) {
+  int top = here();
+  mLoops.push_back(LoopContext());
+  compileStmt(doStmt->getBody());
+  int next = here();
+  int cond = compileCond(doStmt->getCond());
+  emit(OP_JNZ, cond, top);
+  for (int at : mLoops.back().breaks) patch(at, here());
+  for (int at : mLoops.back().continues) patch(at, next);
+  mLoops.pop_back();
+}
+
+void BytecodeCompiler::compileFor(ForStmt* forStmt) {
+  compileStmt(forStmt->getInit());
+  int top = here();
+  int exitJump = -1;
+  if (Expr* condExpr = forStmt->getCond()) {
+    int saved = mNextReg;
+    int cond = compileCond(condExpr);
+    mNextReg = saved;
+    exitJump = emit(OP_JZ, cond);
+  }
+  mLoops.push_back(LoopContext());
+  compileStmt(forStmt->getBody());
+  int next = here();
+  compileStmt(forStmt->getInc());
+  emit(OP_JMP, top);
+  if (exitJump >= 0) patch(exitJump, here());
+  for (int at : mLoops.back().breaks) patch(at, here());
+  for (int at : mLoops.back().continues) patch(at, next);
+  mLoops.pop_back();
+}
+
+int BytecodeCompiler::compileExpr(Expr* expr, int dst) {
+  if (expr->getType()->isIntegerType()) {
+    Expr::EvalResult result;
+    if (expr->EvaluateAsInt(result, mContext)) {
+      int reg = target(dst);
+      emit(OP_LOADK, reg, result.Val.getInt().getExtValue());
+      return reg;
+    }
+  }
+  if (ParenExpr* parenExpr = dyn_cast<ParenExpr>(expr)) {
+    return compileExpr(parenExpr->getSubExpr(), dst);
+  } else if (CastExpr* castexpr = dyn_cast<CastExpr>(expr)) {
+    if (castexpr->getCastKind() == CK_FunctionToPointerDecay)
+      unsupported(expr, "function pointer");
+    int access;
+    CastConversion conversion =
+        getCastConversion(mContext, castexpr, access);
+    if (conversion == CastKeep)
+      return compileExpr(castexpr->getSubExpr(), dst);
+    int val = compileExpr(castexpr->getSubExpr());
+    int reg = target(dst);
+    if (conversion == CastTruncate) {
+      emit(OP_TRUNC, reg, val, access);
+    } else {
+      int zero = newTemp();
+      emit(OP_LOADK, zero, 0);
+      emit(OP_NE, reg, val, zero);
+    }
+    return reg;
+  } else if (DeclRefExpr* declref = dyn_cast<DeclRefExpr>(expr)) {
+    return compileDeclRef(declref, dst);
+  } else if (BinaryOperator* bop = dyn_cast<BinaryOperator>(expr)) {
+    return compileBinop(bop, dst);
+  } else if (UnaryOperator* unaryOperator = dyn_cast<UnaryOperator>(expr)) {
+    return compileUnary(unaryOperator, dst);
+  } else if (CallExpr* callexpr = dyn_cast<CallExpr>(expr)) {
+    return compileCall(callexpr, dst);
+  } else if (ArraySubscriptExpr* arraySubscriptExpr =
+                 dyn_cast<ArraySubscriptExpr>(expr)) {
+    int addr = compileSubscriptAddr(arraySubscriptExpr);
+    if (!isLoadedElement(expr->getType())) return moveTo(addr, dst);
+    int reg = target(dst);
+    emit(OP_LOAD, reg, addr, getAccessCode(mContext, expr->getType()));
+    return reg;
+  } else if (ConditionalOperator* condOperator =
+                 dyn_cast<ConditionalOperator>(expr)) {
+    return compileConditional(condOperator, dst);
+  } else if (isa<UnaryExprOrTypeTraitExpr>(expr)) {
+    int reg = target(dst);
+    emit(OP_LOADK, reg, sizeof(int));
+    return reg;
+  }
+  unsupported(expr, "expression");
+  return -1;
+}
+
+int BytecodeCompiler::compileDeclRef(DeclRefExpr* declref, int dst) {
+  VarSlot slot;
+  if (!mLayout.lookup(declref->getDecl(), slot))
+    unsupported(declref, "reference");
+  if (!slot.isGlobal) return moveTo(slot.index, dst);
+  int reg = target(dst);
+  emit(OP_LOADG, reg, slot.index);
+  return reg;
+}
+
+int BytecodeCompiler::compileBinop(BinaryOperator* bop, int dst) {
+  if (bop->isAssignmentOp()) return compileAssign(bop, dst);
+  if (bop->isLogicalOp()) return compileLogical(bop, dst);
+  if (bop->getOpcode() == BO_Comma) {
+    compileExpr(bop->getLHS());
+    return compileExpr(bop->getRHS(), dst);
+  }
+  uint8_t op;
+  switch (bop->getOpcode()) {
+    case BO_Add: op = OP_ADD; break;
+    case BO_Sub: op = OP_SUB; break;
+    case BO_Mul: op = OP_MUL; break;
+    case BO_Div: op = OP_DIV; break;
+    case BO_Rem: op = OP_REM; break;
+    case BO_LT: op = OP_LT; break;
+    case BO_GT: op = OP_GT; break;
+    case BO_LE: op = OP_LE; break;
+    case BO_GE: op = OP_GE; break;
+    case BO_EQ: op = OP_EQ; break;
+    case BO_NE: op = OP_NE; break;
+    default: {
+      unsupported(bop, "binary operator");
+      return -1;
+    }
+  }
+  int left = compileExpr(bop->getLHS());
+  int right = compileExpr(bop->getRHS());
+  PointerArith arith = getPointerArith(mContext, bop);
+  left = scale(left, arith.leftScale);
+  right = scale(right, arith.rightScale);
+  if (arith.divisor != 1) {
+    int diff = newTemp();
+    emit(op, diff, left, right);
+    int size = newTemp();
+    emit(OP_LOADK, size, arith.divisor);
+    int reg = target(dst);
+    emit(OP_DIV, reg, diff, size);
+    return reg;
+  }
+  int reg = target(dst);
+  emit(op, reg, left, right);
+  return reg;
+}
+
+int BytecodeCompiler::compileAssign(BinaryOperator* bop, int dst) {
+  if (bop->isCompoundAssignmentOp()) unsupported(bop, "compound assignment");
+  Expr* left = bop->getLHS()->IgnoreParens();
+  Expr* right = bop->getRHS();
+  if (DeclRefExpr* declexpr = dyn_cast<DeclRefExpr>(left)) {
+    VarSlot slot;
+    if (!mLayout.lookup(declexpr->getDecl(), slot))
+      unsupported(left, "assignment target");
+    if (!slot.isGlobal) {
+      compileExpr(right, slot.index);
+      return moveTo(slot.index, dst);
+    }
+    int val = compileExpr(right, dst);
+    emit(OP_STOREG, slot.index, val);
+    return val;
+  }
+  int addr;
+  if (UnaryOperator* unaryOperator = dyn_cast<UnaryOperator>(left)) {
+    if (unaryOperator->getOpcode() != UO_Deref)
+      unsupported(left, "assignment target");
+    addr = compileExpr(unaryOperator->getSubExpr());
+  } else if (ArraySubscriptExpr* arraySubscriptExpr =
+                 dyn_cast<ArraySubscriptExpr>(left)) {
+    addr = compileSubscriptAddr(arraySubscriptExpr);
+  } else {
+    unsupported(left, "assignment target");
+    return -1;
+  }
+  int val = compileExpr(right, dst);
+  emit(OP_STORE, addr, val, getAccessCode(mContext, left->getType()));
+  return val;
+}
+
+int BytecodeCompiler::compileLogical(BinaryOperator* bop, int dst) {
+  // Only the result register is written at the end, so dst may alias a
+  // variable read by either operand.
+  bool isAnd = bop->getOpcode() == BO_LAnd;
+  uint8_t shortCircuit = isAnd ? OP_JZ : OP_JNZ;
+  int left = compileCond(bop->getLHS());
+  int skipLeft = emit(shortCircuit, left);
+  int right = compileCond(bop->getRHS());
+  int skipRight = emit(shortCircuit, right);
+  int reg = target(dst);
+  emit(OP_LOADK, reg, isAnd ? 1 : 0);
+  int done = emit(OP_JMP);
+  patch(skipLeft, here());
+  patch(skipRight, here());
+  emit(OP_LOADK, reg, isAnd ? 0 : 1);
+  patch(done, here());
+  return reg;
+}
+
+int BytecodeCompiler::compileUnary(UnaryOperator* unaryOperator, int dst) {
+  Expr* subExpr = unaryOperator->getSubExpr();
+  switch (unaryOperator->getOpcode()) {
+    case UO_Plus:
+      return compileExpr(subExpr, dst);
+    case UO_Minus: {
+      int val = compileExpr(subExpr);
+      int reg = target(dst);
+      emit(OP_NEG, reg, val);
+      return reg;
+    }
+    case UO_LNot: {
+      int val = compileCond(subExpr);
+      int reg = target(dst);
+      emit(OP_NOT, reg, val);
+      return reg;
+    }
+    case UO_Deref: {
+      int addr = compileExpr(subExpr);
+      int reg = target(dst);
+      emit(OP_LOAD, reg, addr,
+           getAccessCode(mContext, unaryOperator->getType()));
+      return reg;
+    }
+    default: {
+      unsupported(unaryOperator, "unary operator");
+      return -1;
+    }
+  }
+}
+
+int BytecodeCompiler::compileCall(CallExpr* callexpr, int dst) {
+  FunctionDecl* callee = callexpr->getDirectCallee();
+  if (!callee) unsupported(callexpr, "indirect call");
+  Decl* canonical = callee->getCanonicalDecl();
+  if (canonical == mInput) {
+    int reg = target(dst);
+    emit(OP_GET, reg);
+    return reg;
+  } else if (canonical == mOutput) {
+    int val = compileExpr(callexpr->getArg(0));
+    emit(OP_PRINT, val);
+    return val;
+  } else if (canonical == mMalloc) {
+    int size = compileExpr(callexpr->getArg(0));
+    int reg = target(dst);
+    emit(OP_MALLOC, reg, size);
+    return reg;
+  } else if (canonical == mFree) {
+    int addr = compileExpr(callexpr->getArg(0));
+    emit(OP_FREE, addr);
+    return moveTo(addr, dst);
+  }
+  auto function = mFunctions.find(canonical);
+  if (function == mFunctions.end()) unsupported(callexpr, "undefined callee");
+  // Arguments go to consecutive registers, the VM copies them into the
+  // parameter registers of the new frame.
+  unsigned numArgs = callexpr->getNumArgs();
+  int argBase = mNextReg;
+  for (unsigned i = 0; i < numArgs; i++) newTemp();
+  for (unsigned i = 0; i < numArgs; i++) {
+    compileExpr(callexpr->getArg(i), argBase + i);
+  }
+  int reg = target(dst);
+  emit(OP_CALL, reg, function->second, argBase);
+  return reg;
+}
+
+int BytecodeCompiler::compileConditional(ConditionalOperator* condOperator,
+                                         int dst) {
+  int cond = compileCond(condOperator->getCond());
+  int reg = target(dst);
+  int skipTrue = emit(OP_JZ, cond);
+  compileExpr(condOperator->getTrueExpr(), reg);
+  int done = emit(OP_JMP);
+  patch(skipTrue, here());
+  compileExpr(condOperator->getFalseExpr(), reg);
+  patch(done, here());
+  return reg;
+}
+
+int BytecodeCompiler::compileSubscriptAddr(
+    ArraySubscriptExpr* arraySubscriptExpr) {
+  int base = compileExpr(arraySubscriptExpr->getBase());
+  int idx = compileExpr(arraySubscriptExpr->getIdx());
+  idx = scale(idx, getElementSize(mContext, arraySubscriptExpr));
+  int addr = newTemp();
+  emit(OP_ADD, addr, base, idx);
+  return addr;
+}
+
+int BytecodeCompiler::newTemp() {
+  int reg = mNextReg++;
+  if (mNextReg > (int)mFn->numRegs) mFn->numRegs = mNextReg;
+  return reg;
+}
+
+int BytecodeCompiler::moveTo(int reg, int dst) {
+  if (dst < 0 || dst == reg) return reg;
+  emit(OP_MOV, dst, reg);
+  return dst;
+}
+
+int BytecodeCompiler::emit(uint8_t op, int a, int b, int c) {
+  mFn->code.push_back(Instr(op, a, b, c));
+  return mFn->code.size() - 1;
+}
+
+void BytecodeCompiler::patch(int at, int label) {
+  Instr& ins = mFn->code[at];
+  if (ins.op == OP_JMP)
+    ins.a = label;
+  else
+    ins.b = label;
+}
+
+int BytecodeCompiler::scale(int reg, int size) {
+  if (size == 1) return reg;
+  int factor = newTemp();
+  emit(OP_LOADK, factor, size);
+  int scaled = newTemp();
+  emit(OP_MUL, scaled, reg, factor);
+  return scaled;
+}
+
+void BytecodeCompiler::unsupported(Stmt* stmt, const char* what) {
+  throw ProgramError(llvm::Twine("Unsupported ") + what +
+                     " in bytecode compiler: " + stmt->getStmtClassName());
+}
@@ -0,0 +1,101 @@
+//==--- BytecodeCompiler.h - Lowering of the AST to bytecode --------------===//
+#ifndef __BYTECODECOMPILER_H
+#define __BYTECODECOMPILER_H
+#include <map>
+#include <vector>
+
+#include "Bytecode.h"
+#include "MemoryAccess.h"
+#include "SlotLayout.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Stmt.h"
+
+using namespace clang;
+
+/// Lowers every FunctionDecl body of a translation unit into register
+/// bytecode once, so BytecodeVM never has to look at the AST again.
+class BytecodeCompiler {
+  struct LoopContext {
+    std::vector<int> breaks;
+    std::vector<int> continues;
+  };
+
+  const ASTContext& mContext;
+  BytecodeModule* mModule;
+
+  FunctionDecl* mFree;  /// Declartions to the built-in functions
+  FunctionDecl* mMalloc;
+  FunctionDecl* mInput;
+  FunctionDecl* mOutput;
+
+  /// Canonical FunctionDecl to its index in BytecodeModule::functions
+  std::map<Decl*, int> mFunctions;
+  /// Globals keep their slot, locals use their slot as register number
+  SlotLayout mLayout;
+
+  // State of the function being lowered
+  BytecodeFunction* mFn;
+  int mNextReg;
+  /// Register holding the address of the function's local array block
+  int mArrayBase;
+  std::vector<LoopContext> mLoops;
+
+ public:
+  explicit BytecodeCompiler(const ASTContext& context)
+      : mContext(context),
+        mModule(NULL),
+        mFree(NULL),
+        mMalloc(NULL),
+        mInput(NULL),
+        mOutput(NULL),
+        mFn(NULL),
+        mNextReg(0),
+        mArrayBase(-1) {}
+
+  /// Lower all function definitions and global initializers in unit.
+  void compile(TranslationUnitDecl* unit, BytecodeModule& module);
+
+ private:
+  void compileFunction(FunctionDecl* fdecl, BytecodeFunction& fn);
+  void compileGlobalInit(const std::vector<VarDecl*>& globals,
+                         BytecodeFunction& fn);
+
+  void compileStmt(Stmt* stmt);
+  void compileDecl(DeclStmt* declstmt);
+  void compileIf(IfStmt* ifstmt);
+  void compileWhile(WhileStmt* whileStmt);
+  void compileDo(DoStmt* doStmt);
+  void compileFor(ForStmt* forStmt);
+
+  /// Evaluate expr and return the register that holds its value. When dst is
+  /// not negative the value is placed in dst.
+  int compileExpr(Expr* expr, int dst = -1);
+  /// Evaluate an operand of OP_JZ, OP_JNZ or OP_NOT, which only test it for
+  /// zero, so its conversion to bool is left out
+  int compileCond(Expr* cond);
+  int compileDeclRef(DeclRefExpr* declref, int dst);
+  int compileBinop(BinaryOperator* bop, int dst);
+  int compileAssign(BinaryOperator* bop, int dst);
+  int compileLogical(BinaryOperator* bop, int dst);
+  int compileUnary(UnaryOperator* unaryOperator, int dst);
+  int compileCall(CallExpr* callexpr, int dst);
+  int compileConditional(ConditionalOperator* condOperator, int dst);
+  /// Compute the heap address of an array subscript into a register
+  int compileSubscriptAddr(ArraySubscriptExpr* arraySubscriptExpr);
+
+  int newTemp();
+  int target(int dst) { return dst >= 0 ? dst : newTemp(); }
+  int moveTo(int reg, int dst);
+  int emit(uint8_t op, int a = 0, int b = 0, int c = 0);
+  int here() { return mFn->code.size(); }
+  void patch(int at, int label);
+  /// Multiply the value in reg by size into a new register, for subscripts
+  /// and pointer arithmetic. A size of 1 returns reg itself.
+  int scale(int reg, int size);
+
+  void unsupported(Stmt* stmt, const char* what);
+};
+
+#endif
@@ -0,0 +1,281 @@
+//==--- BytecodeVM.cpp - Interpreter loop of the vm engine ----------------===//
+#include "BytecodeVM.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#include "ProgramError.h"
+#include "llvm/Support/raw_ostream.h"
+
+void BytecodeVM::initGlobals() { call(mModule.globalInit, 0); }
+
+int BytecodeVM::runEntry() {
+  assert(mModule.entry >= 0 && "no main function");
+  return call(mModule.entry, 0);
+}
+
+int BytecodeVM::call(unsigned fnIdx, unsigned argBase) {
+  const BytecodeFunction& fn = mModule.functions[fnIdx];
+  unsigned base = mTop;
+  unsigned need = base + fn.numRegs;
+  if (mRegs.size() < need)
+    mRegs.resize(std::max<size_t>(need, mRegs.size() * 2));
+  for (unsigned i = 0; i < fn.numParams; i++) {
+    mRegs[base + i] = mRegs[argBase + i];
+  }
+  mTop = need;
+  int frameMark = heap.getFrameMark();
+  int retVal = execute(fnIdx, base);
+  heap.releaseFrame(frameMark);
+  mTop = base;
+  return retVal;
+}
+
+#if defined(ENABLE_COMPUTED_GOTO) && defined(__GNUC__)
+#define VM_THREADED
+#endif
+
+// Handlers are written once and compiled either as labels reached by
+// computed goto (direct threading) or as cases of a switch.
+#ifdef VM_THREADED
+#define TARGET(op) L_##op:
+#define DISPATCH()        \
+  do {                    \
+    ins = ip++;           \
+    goto* ins->handler;   \
+  } while (0)
+#else
+#define TARGET(op) case op:
+#define DISPATCH() continue
+#endif
+
+int BytecodeVM::execute(unsigned fnIdx, unsigned base) {
+#ifdef VM_THREADED
+  static const void* const handlers[] = {
+      &&L_OP_LOADK, &&L_OP_MOV,   &&L_OP_LOADG,  &&L_OP_STOREG,
+      &&L_OP_ADD,   &&L_OP_SUB,   &&L_OP_MUL,    &&L_OP_DIV,
+      &&L_OP_REM,   &&L_OP_LT,    &&L_OP_GT,     &&L_OP_LE,
+      &&L_OP_GE,    &&L_OP_EQ,    &&L_OP_NE,     &&L_OP_NEG,
+      &&L_OP_NOT,   &&L_OP_TRUNC, &&L_OP_LOAD,   &&L_OP_STORE,
+      &&L_OP_JMP,   &&L_OP_JZ,    &&L_OP_JNZ,    &&L_OP_CALL,
+      &&L_OP_RET,   &&L_OP_RETV,  &&L_OP_GET,    &&L_OP_PRINT,
+      &&L_OP_MALLOC, &&L_OP_FREE, &&L_OP_ALLOCA};
+  static_assert(sizeof(handlers) / sizeof(handlers[0]) == OP_NUM_OPCODES,
+                "one handler per opcode");
+  auto codeOf = [&](unsigned idx) {
+    std::vector<ThreadedInstr>& threaded = mThreaded[idx];
+    if (threaded.empty()) {
+      // Translate on first execution: every opcode becomes its handler
+      const BytecodeFunction& fn = mModule.functions[idx];
+      threaded.reserve(fn.code.size());
+      for (const Instr& ins : fn.code) {
+        if (ins.op >= OP_NUM_OPCODES) badOpcode(fn, ins.op);
+        ThreadedInstr t = {handlers[ins.op], ins.a, ins.b, ins.c};
+        threaded.push_back(t);
+      }
+    }
+    return (const ThreadedInstr*)threaded.data();
+  };
+#else
+  auto codeOf = [&](unsigned idx) {
+    return mModule.functions[idx].code.data();
+  };
+#endif
+  const CodeInstr* code = codeOf(fnIdx);
+  const CodeInstr* ip = code;
+  const CodeInstr* ins;
+  // Frames below belong to whoever called execute
+  size_t entryDepth = mFrames.size();
+  int retVal;
+  int* r = mRegs.data() + base;
+#ifdef VM_THREADED
+  DISPATCH();
+  {
+#else
+  while (true) {
+    ins = ip++;
+    switch (ins->op) {
+#endif
+      TARGET(OP_LOADK) {
+        r[ins->a] = ins->b;
+        DISPATCH();
+      }
+      TARGET(OP_MOV) {
+        r[ins->a] = r[ins->b];
+        DISPATCH();
+      }
+      TARGET(OP_LOADG) {
+        r[ins->a] = mGlobals[ins->b];
+        DISPATCH();
+      }
+      TARGET(OP_STOREG) {
+        mGlobals[ins->a] = r[ins->b];
+        DISPATCH();
+      }
+      TARGET(OP_ADD) {
+        r[ins->a] = r[ins->b] + r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_SUB) {
+        r[ins->a] = r[ins->b] - r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_MUL) {
+        r[ins->a] = r[ins->b] * r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_DIV) {
+        checkDivision(r[ins->b], r[ins->c]);
+        r[ins->a] = r[ins->b] / r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_REM) {
+        checkDivision(r[ins->b], r[ins->c]);
+        r[ins->a] = r[ins->b] % r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_LT) {
+        r[ins->a] = r[ins->b] < r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_GT) {
+        r[ins->a] = r[ins->b] > r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_LE) {
+        r[ins->a] = r[ins->b] <= r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_GE) {
+        r[ins->a] = r[ins->b] >= r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_EQ) {
+        r[ins->a] = r[ins->b] == r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_NE) {
+        r[ins->a] = r[ins->b] != r[ins->c];
+        DISPATCH();
+      }
+      TARGET(OP_NEG) {
+        r[ins->a] = -r[ins->b];
+        DISPATCH();
+      }
+      TARGET(OP_NOT) {
+        r[ins->a] = !r[ins->b];
+        DISPATCH();
+      }
+      TARGET(OP_TRUNC) {
+        r[ins->a] = Heap::truncate(r[ins->b], ins->c);
+        DISPATCH();
+      }
+      TARGET(OP_LOAD) {
+        r[ins->a] = heap.Load(r[ins->b], ins->c);
+        DISPATCH();
+      }
+      TARGET(OP_STORE) {
+        heap.Store(r[ins->a], ins->c, r[ins->b]);
+        DISPATCH();
+      }
+      TARGET(OP_JMP) {
+        ip = code + ins->a;
+        DISPATCH();
+      }
+      TARGET(OP_JZ) {
+        if (!r[ins->a]) ip = code + ins->b;
+        DISPATCH();
+      }
+      TARGET(OP_JNZ) {
+        if (r[ins->a]) ip = code + ins->b;
+        DISPATCH();
+      }
+      TARGET(OP_CALL) {
+        unsigned calleeIdx = ins->b;
+        const BytecodeFunction& callee = mModule.functions[calleeIdx];
+        unsigned calleeBase = mTop;
+        size_t need = calleeBase + callee.numRegs;
+        size_t frameBytes = (mFrames.size() + 1) * sizeof(Frame);
+        if (need * sizeof(int) + frameBytes > mStackBudget) stackOverflow();
+        if (mRegs.size() < need) {
+          // Doubling keeps the growth amortized, but the register file
+          // itself must stay inside the budget too
+          size_t limit = (mStackBudget - frameBytes) / sizeof(int);
+          mRegs.resize(std::max(need, std::min(mRegs.size() * 2, limit)));
+          r = mRegs.data() + base;
+        }
+        int* calleeRegs = mRegs.data() + calleeBase;
+        for (unsigned i = 0; i < callee.numParams; i++) {
+          calleeRegs[i] = r[ins->c + i];
+        }
+        Frame frame = {code, ip, fnIdx, base, ins->a, heap.getFrameMark()};
+        mFrames.push_back(frame);
+        mTop = need;
+        fnIdx = calleeIdx;
+        base = calleeBase;
+        r = calleeRegs;
+        code = codeOf(fnIdx);
+        ip = code;
+        DISPATCH();
+      }
+      TARGET(OP_RET) {
+        retVal = r[ins->a];
+        goto ret;
+      }
+      TARGET(OP_RETV) {
+        retVal = 0;
+        goto ret;
+      }
+      TARGET(OP_GET) {
+        r[ins->a] = io.get();
+        DISPATCH();
+      }
+      TARGET(OP_PRINT) {
+        io.print(r[ins->a]);
+        DISPATCH();
+      }
+      TARGET(OP_MALLOC) {
+        r[ins->a] = heap.Malloc(r[ins->b]);
+        DISPATCH();
+      }
+      TARGET(OP_FREE) {
+        heap.Free(r[ins->a]);
+        DISPATCH();
+      }
+      TARGET(OP_ALLOCA) {
+        r[ins->a] = heap.AllocFrame(ins->b);
+        DISPATCH();
+      }
+#ifndef VM_THREADED
+      default:
+        badOpcode(mModule.functions[fnIdx], ins->op);
+    }
+#endif
+  ret: {
+    if (mFrames.size() == entryDepth) return retVal;
+    // Resume the caller
+    const Frame& frame = mFrames.back();
+    heap.releaseFrame(frame.frameMark);
+    mTop = base;
+    code = frame.code;
+    ip = frame.ret;
+    fnIdx = frame.fnIdx;
+    base = frame.base;
+    r = mRegs.data() + base;
+    r[frame.dst] = retVal;
+    mFrames.pop_back();
+    DISPATCH();
+  }
+  }
+}
+
+void BytecodeVM::stackOverflow() {
+  throw ProgramError(
+      "Stack overflow: interpreted calls exceed the stack budget of " +
+      llvm::Twine(mStackBudget) + " bytes");
+}
+
+void BytecodeVM::badOpcode(const BytecodeFunction& fn, unsigned op) {
+  throw ProgramError("Bad opcode " + llvm::Twine(op) + " in " + fn.name);
+}
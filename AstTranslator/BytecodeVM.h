@@ -0,0 +1,91 @@
+//==--- BytecodeVM.h - Interpreter loop of the vm engine ------------------===//
+#ifndef __BYTECODEVM_H
+#define __BYTECODEVM_H
+#include <vector>
+
+#include "Bytecode.h"
+#include "Heap.h"
+#include "IO.h"
+
+/// Executes a BytecodeModule. Frames are windows into one register stack,
+/// so a call only copies its arguments and bumps the stack top. Calls do
+/// not recurse natively: the caller's position is pushed on an explicit
+/// frame stack, so the depth of interpreted recursion is bounded by the
+/// stack budget rather than by the host stack.
+class BytecodeVM {
+  const BytecodeModule& mModule;
+#if defined(ENABLE_COMPUTED_GOTO) && defined(__GNUC__)
+  /// An instruction whose opcode was replaced by its handler's address
+  struct ThreadedInstr {
+    const void* handler;
+    int32_t a;
+    int32_t b;
+    int32_t c;
+  };
+  /// Per function threaded code, translated on first execution
+  std::vector<std::vector<ThreadedInstr>> mThreaded;
+  typedef ThreadedInstr CodeInstr;
+#else
+  typedef Instr CodeInstr;
+#endif
+  /// A caller suspended by OP_CALL
+  struct Frame {
+    /// The caller's code and the instruction after the call
+    const CodeInstr* code;
+    const CodeInstr* ret;
+    unsigned fnIdx;
+    unsigned base;
+    /// Register receiving the return value
+    int32_t dst;
+    /// Heap frame region mark to release the callee's arrays to
+    int32_t frameMark;
+  };
+  std::vector<int> mGlobals;
+  std::vector<int> mRegs;
+  /// First register not used by any live frame
+  unsigned mTop;
+  std::vector<Frame> mFrames;
+  /// Bytes the register and frame stacks may take together
+  size_t mStackBudget;
+
+  Heap heap;
+  ProgramIO io;
+
+ public:
+  static const size_t kDefaultStackBudget = 256 << 20;
+
+  explicit BytecodeVM(const BytecodeModule& module)
+      : mModule(module),
+        mGlobals(module.numGlobals, 0),
+        mRegs(),
+        mTop(0),
+        mStackBudget(kDefaultStackBudget) {
+#if defined(ENABLE_COMPUTED_GOTO) && defined(__GNUC__)
+    mThreaded.resize(module.functions.size());
+#endif
+  }
+
+  /// Run the global initializers, then the entry function
+  int run() {
+    initGlobals();
+    return runEntry();
+  }
+  /// The two halves of run, for callers that snapshot the initialized VM
+  void initGlobals();
+  int runEntry();
+
+  void setStackBudget(size_t bytes) { mStackBudget = bytes; }
+  Heap& getHeap() { return heap; }
+  ProgramIO& getIO() { return io; }
+
+ private:
+  /// Push a frame for function fnIdx, copy its arguments from
+  /// mRegs[argBase...], run it and pop it again.
+  int call(unsigned fnIdx, unsigned argBase);
+  /// Run function fnIdx, and everything it calls, until it returns
+  int execute(unsigned fnIdx, unsigned base);
+  [[noreturn]] static void badOpcode(const BytecodeFunction& fn, unsigned op);
+  [[noreturn]] void stackOverflow();
+};
+
+#endif
@@ -8,12 +8,21 @@
 #include <cassert>
 #include <cstdlib>
 #include <map>
+#include <memory>
 #include <set>
-#include <stack>
 #include <tuple>
 #include <vector>
 
 #include "ASTInterpreter.h"
+#include "Heap.h"
+#include "IO.h"
+#include "Memoizer.h"
+#include "MemoryAccess.h"
+#include "Profiler.h"
+#include "ProgramError.h"
+#include "Sampler.h"
+#include "SlotLayout.h"
+#include "TierUpJIT.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
@@ -27,143 +36,196 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 
+/// Memoizes Expr::EvaluateAsInt per expression. Whether an expression folds
+/// depends only on the AST, so the table is shared by all frames and calls.
+class ConstantCache {
+  struct Folded {
+    bool isConstant;
+    int val;
+  };
+  const ASTContext& mContext;
+  llvm::DenseMap<const Stmt*, Folded> mFolded;
+  bool mEnabled;
+
+ public:
+  ConstantCache(const ASTContext& Context, bool enabled = true)
+      : mContext(Context), mFolded(), mEnabled(enabled) {}
+  void setEnabled(bool enabled) { mEnabled = enabled; }
+
+  /// Return true and set val if stmt is an integer constant expression
+  bool fold(Stmt* stmt, int& val) {
+    if (mEnabled) {
+      auto it = mFolded.find(stmt);
+      if (it != mFolded.end()) {
+        val = it->second.val;
+        return it->second.isConstant;
+      }
+    }
+    Folded folded = {false, 0};
+    if (Expr* expr = llvm::dyn_cast<Expr>(stmt)) {
+      Expr::EvalResult result;
+      if (expr->EvaluateAsInt(result, mContext)) {
+        folded.isConstant = true;
+        folded.val = result.Val.getInt().getExtValue();
+      }
+    }
+    if (mEnabled) mFolded[stmt] = folded;
+    val = folded.val;
+    return folded.isConstant;
+  }
+};
+
+/// A call site resolved by Environment::resolveCall
+struct CallTarget {
+  enum Kind { Input, Output, Malloc, Free, User };
+  Kind kind;
+  /// The callee definition, for user functions
+  FunctionDecl* definition;
+  unsigned numParams;
+  /// Variable and expression slots of the callee's frame and bytes of its
+  /// local arrays, see SlotLayout
+  unsigned frameSize;
+  unsigned numExprs;
+  unsigned arrayBytes;
+  /// Whether results are looked up in and added to the MemoCache
+  bool memoize;
+  CallTarget()
+      : kind(User),
+        definition(NULL),
+        numParams(0),
+        frameSize(0),
+        numExprs(0),
+        arrayBytes(0),
+        memoize(false) {}
+};
+
+/// How the statement that just finished left its enclosing statements
+enum ControlFlow { CF_Normal, CF_Return, CF_Break, CF_Continue };
+
 class StackFrame {
   /// StackFrame maps Variable Declaration to Value
   /// Which are either integer or addresses (also represented using an Integer
-  /// value)
-  std::map<Decl*, int> mVars;
-  std::map<Stmt*, int> mExprs;
+  /// value). Variables and expressions are indexed by their SlotLayout slot.
+  std::vector<int> mVars;
+  std::vector<int> mExprs;
+  const SlotLayout& mLayout;
   /// The current stmt
   Stmt* mPC;
+  /// The function the frame belongs to, NULL while globals are initialized
+  const FunctionDecl* mFunction;
 
   // for call
   int retVal;
-  bool ret;
+  /// Heap address of the block holding the frame's local arrays
+  int arrayBase;
+  /// Set by return, break and continue, checked between statements
+  ControlFlow control;
 
  public:
-  StackFrame() : mVars(), mExprs(), mPC(), ret(false) {}
-  bool shouldRet() { return ret; }
-  void setRet(bool f) { ret = f; }
+  StackFrame(const SlotLayout& layout, unsigned numSlots, unsigned numExprs)
+      : mVars(numSlots, 0),
+        mExprs(numExprs, 0),
+        mLayout(layout),
+        mPC(),
+        mFunction(NULL),
+        retVal(0),
+        arrayBase(0),
+        control(CF_Normal) {}
+  /// Make the frame fresh again for a call needing numSlots variable and
+  /// numExprs expression slots. The storage of the previous activation is
+  /// kept. Every expression is bound before it is read, so its stale values
+  /// are not cleared.
+  void reset(unsigned numSlots, unsigned numExprs) {
+    mVars.assign(numSlots, 0);
+    if (mExprs.size() < numExprs) mExprs.resize(numExprs);
+    mPC = NULL;
+    mFunction = NULL;
+    retVal = 0;
+    arrayBase = 0;
+    control = CF_Normal;
+  }
+  ControlFlow getControl() { return control; }
+  void setControl(ControlFlow flow) { control = flow; }
 
   void setRetVal(int val) { retVal = val; }
   int getRetVal() { return retVal; }
+  void setArrayBase(int addr) { arrayBase = addr; }
+  int getArrayBase() { return arrayBase; }
 
-  void bindDecl(Decl* decl, int val) { mVars[decl] = val; }
-  bool getDeclVal(Decl* decl, int& val) {
-    if (mVars.find(decl) == mVars.end()) {
-      return false;
-    }
-    val = mVars.find(decl)->second;
-    return true;
+  void bindDecl(unsigned slot, int val) { mVars[slot] = val; }
+  int getDeclVal(unsigned slot) { return mVars[slot]; }
+  void bindStmt(Stmt* stmt, int val) {
+    mExprs[mLayout.getExprSlot(stmt)] = val;
   }
-  void bindStmt(Stmt* stmt, int val) { mExprs[stmt] = val; }
-  int getStmtVal(Stmt* stmt, const ASTContext& Context) {
-    if (Expr* expr = llvm::dyn_cast<Expr>(stmt)) {
-      Expr::EvalResult result;
-      if (expr->EvaluateAsInt(result, Context)) {
-        return result.Val.getInt().getExtValue();
-      }
-    }
-    assert(mExprs.find(stmt) != mExprs.end());
-    return mExprs[stmt];
+  int getStmtVal(Stmt* stmt, ConstantCache& constants) {
+    int val;
+    if (constants.fold(stmt, val)) return val;
+    return mExprs[mLayout.getExprSlot(stmt)];
   }
   void setPC(Stmt* stmt) { mPC = stmt; }
   Stmt* getPC() { return mPC; }
+  void setFunction(const FunctionDecl* fdecl) { mFunction = fdecl; }
+  const FunctionDecl* getFunction() { return mFunction; }
 };
 
-/// Heap maps address to a value
-class Heap {
- private:
-  class HeapItem {
-   public:
-    void* start;
-    int size;
-    HeapItem() {}
-    HeapItem(void* _start, int _size) : start(_start), size(_size) {}
-  };
-  class CountAllocator {
-   private:
-    int maxCount;
-
-   public:
-    CountAllocator(int startCount = 0) : maxCount(startCount) {}
-    int allocateCount(int i) {
-      int addr = maxCount;
-      maxCount += i;
-      return addr;
-    }
-    void freeCount(int i) {
-      // Trivial
-    }
-  };
-
- private:
-  std::map<int, HeapItem> items;
-  CountAllocator counter;
+/// The call stack. Popped frames stay allocated and are reset when the
+/// next call pushes them again, so a call and return in steady state does
+/// not go to the system allocator.
+class FrameStack {
+  std::vector<std::unique_ptr<StackFrame>> mFrames;
+  /// Number of live frames
+  unsigned mDepth;
+  const SlotLayout& mLayout;
 
  public:
-  int Malloc(int size) {
-    void* start = static_cast<void*>(new char[size]);
-    HeapItem heapItem(start, size);
-    int idx = counter.allocateCount(size);
-    items[idx] = heapItem;
-    return idx;
-  }
-  void Free(int itemIdx) {
-    auto getRes = get(itemIdx);
-    HeapItem heapItem = std::get<0>(getRes);
-    int idx = std::get<1>(getRes);
-    assert(idx == 0);
-    delete[] static_cast<char*>(heapItem.start);
-    counter.freeCount(itemIdx);
+  explicit FrameStack(const SlotLayout& layout)
+      : mDepth(0), mLayout(layout) {}
+
+  StackFrame& push(unsigned numSlots, unsigned numExprs) {
+    if (mDepth == mFrames.size()) {
+      mFrames.push_back(
+          std::make_unique<StackFrame>(mLayout, numSlots, numExprs));
+    } else {
+      mFrames[mDepth]->reset(numSlots, numExprs);
+    }
+    return *mFrames[mDepth++];
   }
-  void Update(int itemIdx, int val) {
-    auto getRes = get(itemIdx);
-    HeapItem heapItem = std::get<0>(getRes);
-    int idx = std::get<1>(getRes);
-    assert(idx * sizeof(int) < heapItem.size);
-    *(static_cast<int*>(heapItem.start) + idx) = val;
+  void pop() {
+    assert(mDepth > 0);
+    mDepth--;
   }
-  int Get(int itemIdx) {
-    auto getRes = get(itemIdx);
-    HeapItem heapItem = std::get<0>(getRes);
-    int idx = std::get<1>(getRes);
-    assert(idx * sizeof(int) < heapItem.size);
-    return *(static_cast<int*>(heapItem.start) + idx);
+  StackFrame& back() {
+    assert(mDepth > 0);
+    return *mFrames[mDepth - 1];
   }
-
- private:
-  std::tuple<HeapItem, int> get(int itemIdx) {
-    auto it = items.upper_bound(itemIdx);
-    if (it == items.begin()) {
-      assert("Heap Address Not Found\n");
-    }
-    it--;
-    return std::make_tuple(it->second, itemIdx - it->first);
+  /// The live frame at depth i, 0 being the outermost
+  StackFrame& at(unsigned i) {
+    assert(i < mDepth);
+    return *mFrames[i];
   }
+  unsigned size() const { return mDepth; }
 };
 
 class GlobalRegion {
-  std::map<Decl*, int> globals;
+  std::vector<int> globals;
 
  public:
-  void bindDecl(Decl* decl, int val) { globals[decl] = val; }
-  bool getDecl(Decl* decl, int& val) {
-    if (globals.find(decl) == globals.end()) {
-      return false;
-    }
-    val = globals[decl];
-    return true;
-  }
+  void init(unsigned numGlobals) { globals.assign(numGlobals, 0); }
+  void bindDecl(unsigned slot, int val) { globals[slot] = val; }
+  int getDecl(unsigned slot) { return globals[slot]; }
+  int* data() { return globals.data(); }
 };
 
 class Environment {
-  std::vector<StackFrame> mStack;
+  SlotLayout layout;
+  FrameStack mStack;
 
   FunctionDecl* mFree;  /// Declartions to the built-in functions
   FunctionDecl* mMalloc;
@@ -173,21 +235,35 @@ class Environment {
   FunctionDecl* mEntry;
 
   const ASTContext& mContext;
+  ConstantCache mConstants;
 
   GlobalRegion globalRegion;
 
   Heap heap;
+  ProgramIO io;
 
   InterpreterVisitor* visitor;
 
-  // Temp variables, not useful for others
-  std::stack<int> tempHeapAddr;
+  /// Call sites resolved on their first execution
+  llvm::DenseMap<const CallExpr*, CallTarget> mCallTargets;
+
+#ifdef ENABLE_ORC_JIT
+  std::unique_ptr<TierUpJIT> jit;
+#endif
+  /// Set when statements and calls should be profiled
+  std::unique_ptr<StmtProfiler> profiler;
+  /// Set when the interpreted call stack should be sampled
+  std::unique_ptr<StackSampler> sampler;
+  /// Set when calls of pure functions should be memoized
+  PurityAnalysis purity;
+  std::unique_ptr<MemoCache> memo;
 
  public:
   /// Get the declartions to the built-in functions
   Environment(const ASTContext& Context)
       : mContext(Context),
-        mStack(),
+        mConstants(Context),
+        mStack(layout),
         mFree(NULL),
         mMalloc(NULL),
         mInput(NULL),
@@ -195,16 +271,27 @@ class Environment {
         mEntry(NULL) {}
 
   bool getDecl(Decl* decl, int& val) {
-    bool find = false;
-    find |= mStack.back().getDeclVal(decl, val);
-    if (find) return find;
-    find |= globalRegion.getDecl(decl, val);
-    return find;
+    VarSlot slot;
+    if (!layout.lookup(decl, slot)) return false;
+    val = slot.isGlobal ? globalRegion.getDecl(slot.index)
+                        : mStack.back().getDeclVal(slot.index);
+    return true;
+  }
+  void bindDecl(Decl* decl, int val) {
+    VarSlot slot;
+    bool find = layout.lookup(decl, slot);
+    assert(find && "variable without a slot");
+    if (slot.isGlobal)
+      globalRegion.bindDecl(slot.index, val);
+    else
+      mStack.back().bindDecl(slot.index, val);
   }
   /// Initialize the Environment
   void init(TranslationUnitDecl* unit, InterpreterVisitor* _visitor) {
     visitor = _visitor;
-    mStack.push_back(StackFrame());
+    layout.build(unit);
+    globalRegion.init(layout.getNumGlobals());
+    mStack.push(0, layout.getNumInitExprs());
     for (TranslationUnitDecl::decl_iterator i = unit->decls_begin(),
                                             e = unit->decls_end();
          i != e; ++i) {
@@ -223,47 +310,100 @@ class Environment {
         int init = 0;
         if (vdecl->hasInit()) {
           visitor->Visit(vdecl->getInit());
-          init = mStack.back().getStmtVal(vdecl->getInit(), mContext);
+          init = mStack.back().getStmtVal(vdecl->getInit(), mConstants);
         }
-        globalRegion.bindDecl(vdecl, init);
+        bindDecl(vdecl, init);
       }
     }
-    mStack.pop_back();
-    mStack.push_back(StackFrame());
+    mStack.pop();
+    FunctionDecl* entry = mEntry->getDefinition();
+    mStack.push(layout.getFrameSize(entry), layout.getNumExprs(entry));
+    mStack.back().setFunction(entry);
+    if (unsigned arrayBytes = layout.getArrayBytes(entry))
+      mStack.back().setArrayBase(heap.AllocFrame(arrayBytes));
   }
 
   FunctionDecl* getEntry() { return mEntry; }
+  ConstantCache& getConstants() { return mConstants; }
+  Heap& getHeap() { return heap; }
+  ProgramIO& getIO() { return io; }
+
+  void enableProfiler() {
+    profiler.reset(new StmtProfiler(mContext.getSourceManager()));
+  }
+  StmtProfiler* getProfiler() { return profiler.get(); }
+
+  /// Reuse the results of calls to pure functions with the same arguments.
+  /// Call before the first call is made.
+  void enableMemoizer(TranslationUnitDecl* unit) {
+    purity.build(unit);
+    memo.reset(new MemoCache());
+  }
+  MemoCache* getMemoCache() { return memo.get(); }
+
+  /// Sample the interpreted call stack hz times a second of CPU time
+  void enableSampler(unsigned hz) { sampler.reset(new StackSampler(hz)); }
+  StackSampler* getSampler() { return sampler.get(); }
+  /// Called between statements: account the samples that arrived since
+  /// the last call to the current call stack, as "function:line" frames
+  void sample() {
+    if (!sampler || !sampler->hasPending()) return;
+    unsigned count = sampler->takePending();
+    const SourceManager& sourceManager = mContext.getSourceManager();
+    std::string stack;
+    for (unsigned i = 0; i < mStack.size(); i++) {
+      StackFrame& frame = mStack.at(i);
+      const FunctionDecl* function = frame.getFunction();
+      if (!function) continue;
+      SourceLocation loc = frame.getPC() ? frame.getPC()->getBeginLoc()
+                                         : function->getLocation();
+      if (!stack.empty()) stack += ';';
+      stack += function->getNameAsString();
+      stack += ':';
+      stack += std::to_string(sourceManager.getPresumedLineNumber(loc));
+    }
+    sampler->add(stack, count);
+  }
+
+#ifdef ENABLE_ORC_JIT
+  /// Run functions natively once they were called more than threshold
+  /// times. Call after init, the globals must not move anymore.
+  void enableJIT(unsigned threshold) {
+    jit.reset(new TierUpJIT(mContext, layout, mFree, mMalloc, mInput, mOutput,
+                            heap, io, globalRegion.data(), threshold));
+  }
+  TierUpJIT* getJIT() { return jit.get(); }
+#endif
 
   /// !TODO Support comparison operation
   void binop(BinaryOperator* bop) {
-    if (mStack.back().shouldRet()) return;
     Expr* left = bop->getLHS();
     Expr* right = bop->getRHS();
 
     if (bop->isAssignmentOp()) {
-      int val = mStack.back().getStmtVal(right, mContext);
-      mStack.back().bindStmt(left, val);
-      if (DeclRefExpr* declexpr = dyn_cast<DeclRefExpr>(left)) {
-        Decl* decl = declexpr->getFoundDecl();
-        mStack.back().bindDecl(decl, val);
+      int val = mStack.back().getStmtVal(right, mConstants);
+      if (DeclRefExpr* declexpr = dyn_cast<DeclRefExpr>(left->IgnoreParens())) {
+        bindDecl(declexpr->getFoundDecl(), val);
       } else {
-        while (tempHeapAddr.size() > 1) tempHeapAddr.pop();
-        heap.Update(tempHeapAddr.top(), val);
-        tempHeapAddr.pop();
+        heap.Store(lvalueAddr(left), getAccessCode(mContext, left->getType()),
+                   val);
       }
-      while (tempHeapAddr.size()) tempHeapAddr.pop();
+      mStack.back().bindStmt(bop, val);
       return;
     }
-    int leftVal = mStack.back().getStmtVal(left, mContext);
-    int rightVal = mStack.back().getStmtVal(right, mContext);
+    int leftVal = mStack.back().getStmtVal(left, mConstants);
+    int rightVal = mStack.back().getStmtVal(right, mConstants);
     int resultVal;
     switch (bop->getOpcode()) {
       case clang::BO_Add: {
-        resultVal = leftVal + rightVal;
+        PointerArith arith = getPointerArith(mContext, bop);
+        resultVal = leftVal * arith.leftScale + rightVal * arith.rightScale;
         break;
       }
       case clang::BO_Sub: {
-        resultVal = leftVal - rightVal;
+        PointerArith arith = getPointerArith(mContext, bop);
+        resultVal = leftVal * arith.leftScale - rightVal * arith.rightScale;
+        if (arith.divisor != 1) resultVal /= arith.divisor;
         break;
       }
       case clang::BO_Mul: {
@@ -271,7 +411,7 @@ class Environment {
         break;
       }
       case clang::BO_Div: {
-        assert(rightVal != 0);
+        checkDivision(leftVal, rightVal);
         resultVal = leftVal / rightVal;
         break;
       }
@@ -291,10 +431,19 @@ class Environment {
         resultVal = (leftVal <= rightVal);
         break;
       }
+      case clang::BO_Rem: {
+        checkDivision(leftVal, rightVal);
+        resultVal = leftVal % rightVal;
+        break;
+      }
       case clang::BO_EQ: {
         resultVal = (leftVal == rightVal);
         break;
       }
+      case clang::BO_NE: {
+        resultVal = (leftVal != rightVal);
+        break;
+      }
       default: {
         llvm::errs() << "Not Supportted Opcode in Binop!\n";
       }
@@ -303,30 +452,28 @@ class Environment {
   }
 
   void decl(DeclStmt* declstmt) {
-    if (mStack.back().shouldRet()) return;
     for (DeclStmt::decl_iterator it = declstmt->decl_begin(),
                                  ie = declstmt->decl_end();
          it != ie; ++it) {
       Decl* decl = *it;
       if (VarDecl* vardecl = dyn_cast<VarDecl>(decl)) {
-        if (auto constantArrayType =
-                dyn_cast<ConstantArrayType>(vardecl->getType().getTypePtr())) {
-          int heapAddr = heap.Malloc(
-              constantArrayType->getSize().getSExtValue() * sizeof(int));
-          mStack.back().bindDecl(vardecl, heapAddr);
+        if (isa<ConstantArrayType>(vardecl->getType().getTypePtr())) {
+          // The storage is part of the frame's array block, see call()
+          VarSlot slot;
+          layout.lookup(vardecl, slot);
+          bindDecl(vardecl, mStack.back().getArrayBase() + slot.arrayOffset);
         } else {
           int init = 0;
           if (vardecl->hasInit()) {
-            init = mStack.back().getStmtVal(vardecl->getInit(), mContext);
+            init = mStack.back().getStmtVal(vardecl->getInit(), mConstants);
           }
-          mStack.back().bindDecl(vardecl, init);
+          bindDecl(vardecl, init);
         }
       }
     }
   }
 
   void declref(DeclRefExpr* declref) {
-    if (mStack.back().shouldRet()) return;
     mStack.back().setPC(declref);
     if (declref->getType()->isIntegerType() ||
         declref->getType()->isPointerType() &&
@@ -336,80 +483,158 @@ class Environment {
       // llvm::errs() << "find decl: " << decl << "\n";
       int val;
       bool find = getDecl(decl, val);
-      if (!find) {
-        llvm::errs() << "Get Decl Failed\n";
-        exit(-1);
-      }
+      if (!find) throw ProgramError("Get Decl Failed");
       mStack.back().bindStmt(declref, val);
     }
   }
 
   void cast(CastExpr* castexpr) {
-    if (mStack.back().shouldRet()) return;
     mStack.back().setPC(castexpr);
     if (castexpr->getType()->isIntegerType() ||
         castexpr->getType()->isPointerType() &&
             !castexpr->getType()->isFunctionPointerType() ||
         castexpr->getType()->isArrayType()) {
       Expr* expr = castexpr->getSubExpr();
-      int val = mStack.back().getStmtVal(expr, mContext);
+      int val = mStack.back().getStmtVal(expr, mConstants);
+      int access;
+      switch (getCastConversion(mContext, castexpr, access)) {
+        case CastTruncate:
+          val = Heap::truncate(val, access);
+          break;
+        case CastToBool:
+          val = val != 0;
+          break;
+        default:
+          break;
+      }
       mStack.back().bindStmt(castexpr, val);
     }
   }
 
-  /// !TODO Support Function Call
-  void call(CallExpr* callexpr) {
-    if (mStack.back().shouldRet()) return;
-    mStack.back().setPC(callexpr);
-    int val = 0;
+  /// Resolve the callee of a call site once and cache it
+  const CallTarget& resolveCall(CallExpr* callexpr) {
+    auto it = mCallTargets.find(callexpr);
+    if (it != mCallTargets.end()) return it->second;
+    CallTarget target;
     FunctionDecl* callee = callexpr->getDirectCallee();
     if (callee == mInput) {
-      //   llvm::errs() << "Please Input an Integer Value : ";
-      scanf("%d", &val);
-
-      mStack.back().bindStmt(callexpr, val);
+      target.kind = CallTarget::Input;
     } else if (callee == mOutput) {
-      Expr* decl = callexpr->getArg(0);
-      val = mStack.back().getStmtVal(decl, mContext);
-      llvm::errs() << val;
+      target.kind = CallTarget::Output;
     } else if (callee == mMalloc) {
-      Expr* expr = callexpr->getArg(0);
-      val = mStack.back().getStmtVal(expr, mContext);
-      int addr = heap.Malloc(val);
-      mStack.back().bindStmt(callexpr, addr);
+      target.kind = CallTarget::Malloc;
     } else if (callee == mFree) {
-      Expr* expr = callexpr->getArg(0);
-      int addr = mStack.back().getStmtVal(expr, mContext);
-      heap.Free(addr);
-      mStack.back().bindStmt(callexpr, addr);
+      target.kind = CallTarget::Free;
     } else {
-      /// You could add your code here for Function call Return
-      callee = callee->getDefinition();
-      StackFrame newFrame;
-      for (int i = 0; i < callee->getNumParams(); i++) {
-        int val = mStack.back().getStmtVal(callexpr->getArg(i), mContext);
-        // llvm::errs() << "function: " << callee->getNameAsString() << "\n";
-        // llvm::errs() << "bind Decl: " << callee->getParamDecl(i) << " " <<
-        // val
-        //              << "\n";
-        newFrame.bindDecl(callee->getParamDecl(i), val);
+      target.kind = CallTarget::User;
+      target.definition = callee->getDefinition();
+      if (!target.definition)
+        throw ProgramError("Call to undefined function " +
+                           callee->getNameAsString());
+      target.numParams = target.definition->getNumParams();
+      target.frameSize = layout.getFrameSize(target.definition);
+      target.numExprs = layout.getNumExprs(target.definition);
+      target.arrayBytes = layout.getArrayBytes(target.definition);
+      target.memoize = memo && purity.isPure(target.definition) &&
+                       target.numParams <= MemoCache::kMaxArgs;
+    }
+    return mCallTargets[callexpr] = target;
+  }
+
+  void call(CallExpr* callexpr) {
+    mStack.back().setPC(callexpr);
+    int val = 0;
+    // A copy: calls resolved while the body runs may rehash mCallTargets
+    const CallTarget target = resolveCall(callexpr);
+    switch (target.kind) {
+      case CallTarget::Input: {
+        //   llvm::errs() << "Please Input an Integer Value : ";
+        val = io.get();
+        mStack.back().bindStmt(callexpr, val);
+        break;
+      }
+      case CallTarget::Output: {
+        Expr* decl = callexpr->getArg(0);
+        val = mStack.back().getStmtVal(decl, mConstants);
+        io.print(val);
+        break;
+      }
+      case CallTarget::Malloc: {
+        Expr* expr = callexpr->getArg(0);
+        val = mStack.back().getStmtVal(expr, mConstants);
+        int addr = heap.Malloc(val);
+        mStack.back().bindStmt(callexpr, addr);
+        break;
+      }
+      case CallTarget::Free: {
+        Expr* expr = callexpr->getArg(0);
+        int addr = mStack.back().getStmtVal(expr, mConstants);
+        heap.Free(addr);
+        mStack.back().bindStmt(callexpr, addr);
+        break;
+      }
+      case CallTarget::User: {
+        // Parameters take the first slots of the frame, so the arguments
+        // are evaluated in the caller's frame and copied over in order
+        llvm::SmallVector<int, 8> args;
+        for (unsigned i = 0; i < target.numParams; i++) {
+          args.push_back(
+              mStack.back().getStmtVal(callexpr->getArg(i), mConstants));
+        }
+        int retVal;
+        if (target.memoize &&
+            memo->lookup(target.definition, args.data(), target.numParams,
+                         retVal)) {
+          mStack.back().bindStmt(callexpr, retVal);
+          return;
+        }
+#ifdef ENABLE_ORC_JIT
+        if (jit) {
+          if (NativeEntry entry = jit->enter(target.definition)) {
+            retVal = jit->invoke(entry, args.data());
+            if (target.memoize)
+              memo->insert(target.definition, args.data(), target.numParams,
+                           retVal);
+            mStack.back().bindStmt(callexpr, retVal);
+            return;
+          }
+        }
+#endif
+        int frameMark = heap.getFrameMark();
+        mStack.push(target.frameSize, target.numExprs);
+        mStack.back().setFunction(target.definition);
+        if (target.arrayBytes)
+          mStack.back().setArrayBase(heap.AllocFrame(target.arrayBytes));
+        for (unsigned i = 0; i < target.numParams; i++) {
+          mStack.back().bindDecl(i, args[i]);
+        }
+        if (profiler) {
+          StmtProfiler::Scope scope(*profiler, target.definition);
+          visitor->Visit(target.definition->getBody());
+        } else {
+          visitor->Visit(target.definition->getBody());
+        }
+        retVal = mStack.back().getRetVal();
+        mStack.pop();
+        heap.releaseFrame(frameMark);
+        if (target.memoize)
+          memo->insert(target.definition, args.data(), target.numParams,
+                       retVal);
+        mStack.back().bindStmt(callexpr, retVal);
+        break;
       }
-      mStack.push_back(newFrame);
-      visitor->VisitStmt(callee->getBody());
-      int retVal = mStack.back().getRetVal();
-      mStack.pop_back();
-      mStack.back().bindStmt(callexpr, retVal);
     }
   }
   void ret(ReturnStmt* returnStmt) {
-    if (mStack.back().shouldRet()) return;
     Expr* expr = returnStmt->getRetValue();
-    int retVal = mStack.back().getStmtVal(expr, mContext);
+    int retVal = expr ? mStack.back().getStmtVal(expr, mConstants) : 0;
     mStack.back().setRetVal(retVal);
-    mStack.back().setRet(true);
+    mStack.back().setControl(CF_Return);
   }
+
+  ControlFlow getControl() { return mStack.back().getControl(); }
+  void setControl(ControlFlow flow) { mStack.back().setControl(flow); }
   void unary(UnaryOperator* unaryOperator) {
-    if (mStack.back().shouldRet()) return;
     mStack.back().setPC(unaryOperator);
     Expr* subExpr = unaryOperator->getSubExpr();
     int val;
@@ -419,13 +644,13 @@ class Environment {
         break;
       }
       case clang::UO_Deref: {
-        int addr = mStack.back().getStmtVal(subExpr, mContext);
-        val = heap.Get(addr);
-        tempHeapAddr.push(addr);
+        int addr = mStack.back().getStmtVal(subExpr, mConstants);
+        val = heap.Load(addr,
+                        getAccessCode(mContext, unaryOperator->getType()));
         break;
       }
       case clang::UO_Minus: {
-        val = -mStack.back().getStmtVal(subExpr, mContext);
+        val = -mStack.back().getStmtVal(subExpr, mConstants);
         break;
       }
     }
@@ -433,36 +658,69 @@ class Environment {
     return;
   }
 
+  /// Bind the value of && or || once the deciding operand is known
+  void logical(BinaryOperator* bop, bool val) {
+    mStack.back().setPC(bop);
+    mStack.back().bindStmt(bop, val);
+  }
+
+  /// Bind the value of ?: to that of the operand that was evaluated
+  void conditional(ConditionalOperator* condOperator, Expr* chosen) {
+    mStack.back().setPC(condOperator);
+    mStack.back().bindStmt(condOperator,
+                           mStack.back().getStmtVal(chosen, mConstants));
+  }
+
   bool getCond(Stmt* cond) {
-    if (mStack.back().shouldRet()) return false;
     mStack.back().setPC(cond);
-    return mStack.back().getStmtVal(cond, mContext) != 0;
+    return mStack.back().getStmtVal(cond, mConstants) != 0;
   }
 
   void unaryExprOrTypeTraitExpr(
       UnaryExprOrTypeTraitExpr* unaryExprOrTypeTraitExpr) {
-    if (mStack.back().shouldRet()) return;
     mStack.back().setPC(unaryExprOrTypeTraitExpr);
     mStack.back().bindStmt(unaryExprOrTypeTraitExpr, sizeof(int));
   }
 
   void parenExpr(ParenExpr* parenExpr) {
-    if (mStack.back().shouldRet()) return;
     Expr* subExpr = parenExpr->getSubExpr();
-    int val = mStack.back().getStmtVal(subExpr, mContext);
+    int val = mStack.back().getStmtVal(subExpr, mConstants);
     mStack.back().bindStmt(parenExpr, val);
   }
   void arraySubscriptExpr(ArraySubscriptExpr* arraySubscriptExpr) {
-    if (mStack.back().shouldRet()) return;
     mStack.back().setPC(arraySubscriptExpr);
-    int idx = mStack.back().getStmtVal(arraySubscriptExpr->getIdx(), mContext);
-    int base =
-        mStack.back().getStmtVal(arraySubscriptExpr->getBase(), mContext);
-    int addr = base + idx;
-    int val = heap.Get(addr);
-    tempHeapAddr.push(addr);
+    QualType type = arraySubscriptExpr->getType();
+    int addr = subscriptAddr(arraySubscriptExpr);
+    int val = addr;
+    if (isLoadedElement(type))
+      val = heap.Load(addr, getAccessCode(mContext, type));
     mStack.back().bindStmt(arraySubscriptExpr, val);
   }
+
+  /// Heap address of an assignment target, a deref or a subscript whose
+  /// operands InterpreterVisitor::visitLValue has evaluated. The target
+  /// itself is never loaded.
+  int lvalueAddr(Expr* lvalue) {
+    lvalue = lvalue->IgnoreParens();
+    if (UnaryOperator* unaryOperator = dyn_cast<UnaryOperator>(lvalue)) {
+      if (unaryOperator->getOpcode() == UO_Deref)
+        return mStack.back().getStmtVal(unaryOperator->getSubExpr(),
+                                        mConstants);
+    } else if (ArraySubscriptExpr* arraySubscriptExpr =
+                   dyn_cast<ArraySubscriptExpr>(lvalue)) {
+      return subscriptAddr(arraySubscriptExpr);
+    }
+    throw ProgramError(llvm::Twine("Unsupported assignment target ") +
+                       lvalue->getStmtClassName());
+  }
+
+  int subscriptAddr(ArraySubscriptExpr* arraySubscriptExpr) {
+    int idx =
+        mStack.back().getStmtVal(arraySubscriptExpr->getIdx(), mConstants);
+    int base =
+        mStack.back().getStmtVal(arraySubscriptExpr->getBase(), mConstants);
+    return base + idx * getElementSize(mContext, arraySubscriptExpr);
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+//==--- ForkServer.h - Warm process that forks per request ----------------===//
+#ifndef __FORKSERVER_H
+#define __FORKSERVER_H
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "IO.h"
+#include "ProgramError.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// Runs one parsed and initialized program against many GET input streams.
+/// The engine is set up once, up to and including the global initializers;
+/// every request then forks that snapshot, so the child starts from the
+/// initialized Heap and globals through copy-on-write pages and nothing it
+/// does is seen by the next request.
+///
+/// Requests are read from stdin, one "<input> [<output>]" line each. The
+/// output defaults to <input>.out and may also be stderr or stdout. For
+/// every request one "<input> <exit code> <ms>" line is written and flushed
+/// to stdout, so a driver can stream requests through a pipe.
+class ForkServer {
+  ProgramIO& mIO;
+
+ public:
+  explicit ForkServer(ProgramIO& io) : mIO(io) {}
+
+  /// Serve requests until end of input, running runEntry in every child
+  void serve(llvm::function_ref<void()> runEntry) {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      llvm::StringRef request = llvm::StringRef(line).trim();
+      if (request.empty() || request.startswith("#")) continue;
+      std::pair<llvm::StringRef, llvm::StringRef> fields =
+          request.split(' ');
+      std::string input = fields.first.str();
+      std::string output = fields.second.trim().str();
+      if (output.empty()) output = input + ".out";
+
+      auto start = std::chrono::steady_clock::now();
+      int status = runChild(input, output, runEntry);
+      double millis = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+      llvm::outs() << input << " " << status << " "
+                   << llvm::format("%.3f", millis) << "\n";
+      llvm::outs().flush();
+    }
+  }
+
+ private:
+  /// Fork, run the program on one input in the child and return its exit
+  /// code, or 128 plus the signal that killed it
+  int runChild(const std::string& input, const std::string& output,
+               llvm::function_ref<void()> runEntry) {
+    // Anything still buffered would otherwise be written by every child
+    mIO.flush();
+    llvm::outs().flush();
+    llvm::errs().flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+      llvm::errs() << "Cannot fork: " << strerror(errno) << "\n";
+      exit(-1);
+    }
+    if (pid == 0) {
+      int inputFd = open(input.c_str(), O_RDONLY);
+      if (inputFd < 0) {
+        llvm::errs() << "Cannot read " << input << "\n";
+        _exit(-1);
+      }
+      if (!mIO.setOutput(output)) {
+        llvm::errs() << "Cannot open " << output << " for PRINT output\n";
+        _exit(-1);
+      }
+      mIO.setInput(inputFd);
+      // The error must not unwind into the copy of the server loop
+      int exitCode = 0;
+      try {
+        runEntry();
+      } catch (const ProgramError& error) {
+        mIO.flush();
+        llvm::errs() << error.what() << "\n";
+        exitCode = -1;
+      }
+      mIO.flush();
+      llvm::outs().flush();
+      // Leave without running the destructors of the parent's state
+      _exit(exitCode);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR) return -1;
+    }
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+  }
+};
+
+#endif
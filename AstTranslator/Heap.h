@@ -0,0 +1,308 @@
+//==--- Heap.h - Byte addressed memory of a program -----------------------===//
+#ifndef __HEAP_H
+#define __HEAP_H
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "ProgramError.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// Heap maps address to a value. MALLOC blocks live in one contiguous byte
+/// arena, so their address is directly an index into it. The local arrays
+/// of the active calls live in a second arena whose addresses start at
+/// kFrameBase; they are bump allocated and released a whole frame at a
+/// time. Both arenas only grow as far as the program actually uses them.
+/// Loads and stores are typed by an access code: the width in bytes (1, 2,
+/// 4 or 8), negated when the value is zero rather than sign extended. Values
+/// are ints; an 8 byte store extends them and an 8 byte load truncates.
+class Heap {
+ private:
+  /// Hands out byte ranges of the arena, aligned to kAlign. Small blocks are
+  /// rounded up to a power-of-two size class and recycled through per-class
+  /// free lists, larger blocks are recycled best-fit from a size-ordered
+  /// free map.
+  class SizeClassAllocator {
+   private:
+    static const int kNumClasses = 19;
+    static const int kMaxClassBytes = 1 << (kNumClasses - 1);
+    std::vector<int> freeLists[kNumClasses];
+    std::multimap<int, int> largeFree;
+    int top;
+
+    static int sizeClass(int bytes) {
+      int c = 0;
+      while ((1 << c) < bytes) c++;
+      return c;
+    }
+
+   public:
+    static const int kAlign = 8;
+
+    explicit SizeClassAllocator(int base) : top(base) {}
+    /// The block size actually handed out for a request of bytes
+    static int roundUp(int bytes) {
+      if (bytes > kMaxClassBytes) return alignUp(bytes);
+      return 1 << sizeClass(bytes < kAlign ? kAlign : bytes);
+    }
+    static int alignUp(int bytes) {
+      return (bytes + kAlign - 1) / kAlign * kAlign;
+    }
+    /// Allocate a block of at least roundUp(bytes) bytes and update bytes to
+    /// its real size. reused is set when the block comes from a free list
+    /// instead of the top of the arena.
+    int allocate(int& bytes, bool& reused) {
+      bytes = roundUp(bytes);
+      reused = true;
+      if (bytes <= kMaxClassBytes) {
+        std::vector<int>& freeList = freeLists[sizeClass(bytes)];
+        if (!freeList.empty()) {
+          int addr = freeList.back();
+          freeList.pop_back();
+          return addr;
+        }
+      } else {
+        // Best fit, but do not waste more than the small classes would
+        auto it = largeFree.lower_bound(bytes);
+        if (it != largeFree.end() && it->first / 2 < bytes) {
+          int addr = it->second;
+          bytes = it->first;
+          largeFree.erase(it);
+          return addr;
+        }
+      }
+      reused = false;
+      int addr = top;
+      top += bytes;
+      return addr;
+    }
+    void release(int addr, int bytes) {
+      if (bytes <= kMaxClassBytes)
+        freeLists[sizeClass(bytes)].push_back(addr);
+      else
+        largeFree.insert(std::make_pair(bytes, addr));
+    }
+  };
+
+ public:
+  /// Counters that show whether the arena tracks live data
+  struct Stats {
+    uint64_t mallocs;
+    uint64_t frees;
+    /// Mallocs served from a free list
+    uint64_t reused;
+    int64_t liveBytes;
+    int64_t peakLiveBytes;
+    /// Size of the arena, the interpreter's real heap footprint
+    int64_t arenaBytes;
+    /// High-water mark of the frame region
+    int64_t peakFrameBytes;
+    Stats()
+        : mallocs(0),
+          frees(0),
+          reused(0),
+          liveBytes(0),
+          peakLiveBytes(0),
+          arenaBytes(0),
+          peakFrameBytes(0) {}
+  };
+
+  /// Room for the local arrays of all active calls, like a native stack
+  static const int kFrameRegionBytes = 4 << 20;
+  /// First address of the frame arena, and the limit of the MALLOC arena
+  static const int kFrameBase = 1 << 30;
+
+ private:
+  std::vector<char> arena;
+  std::vector<char> frames;
+  /// Start address of every live block and its size in bytes, ordered so
+  /// that debug builds can find the block an access falls into
+  std::map<int, int> blocks;
+  SizeClassAllocator allocator;
+  /// Next free address of the frame arena
+  int frameTop;
+  Stats stats;
+
+  void reserve(size_t bytes) {
+    if (arena.size() < bytes) arena.resize(bytes);
+    stats.arenaBytes = arena.size();
+  }
+  [[noreturn]] static void outOfMemory() {
+    throw ProgramError("Out of memory: heap exceeds " +
+                       llvm::Twine(kFrameBase) + " bytes");
+  }
+  /// The byte behind addr in whichever arena holds it
+  char* locate(int addr, int access) {
+    size_t width = access < 0 ? -access : access;
+#ifndef NDEBUG
+    checkBounds(addr, width);
+#endif
+    if (addr >= kFrameBase) return &frames[addr - kFrameBase];
+    return &arena[addr];
+  }
+  /// Reject an access that is not inside one live MALLOC block or the live
+  /// part of the frame arena. Blocks count with their rounded up size.
+  void checkBounds(int addr, size_t width) {
+    int64_t end = (int64_t)addr + width;
+    if (addr >= kFrameBase) {
+      if (end <= frameTop) return;
+    } else {
+      auto it = blocks.upper_bound(addr);
+      if (it != blocks.begin() && end <= (int64_t)(--it)->first + it->second)
+        return;
+    }
+    throw ProgramError("Heap access out of bounds at address " +
+                       llvm::Twine(addr));
+  }
+
+ public:
+  /// Address 0 is never handed out, so it stays usable as a null pointer
+  Heap() : allocator(SizeClassAllocator::kAlign), frameTop(kFrameBase) {}
+
+  /// Allocate a zeroed block of at least size bytes
+  int Malloc(int size) {
+    if (size < 0)
+      throw ProgramError("MALLOC of a negative size " + llvm::Twine(size));
+    // Larger requests would overflow rounding them up to a size class
+    if (size > kFrameBase) outOfMemory();
+    int bytes = std::max(1, size);
+    bool reused;
+    int idx = allocator.allocate(bytes, reused);
+    if (bytes > kFrameBase - idx) outOfMemory();
+    reserve((size_t)idx + bytes);
+    if (reused) std::memset(&arena[idx], 0, bytes);
+    blocks[idx] = bytes;
+    stats.mallocs++;
+    stats.reused += reused;
+    stats.liveBytes += bytes;
+    stats.peakLiveBytes = std::max(stats.peakLiveBytes, stats.liveBytes);
+    return idx;
+  }
+
+  /// Mark of the frame region to hand to releaseFrame when a call returns
+  int getFrameMark() const { return frameTop; }
+  /// Allocate a zeroed block of size bytes on top of the frame region. Its
+  /// address is also the mark that releases it.
+  int AllocFrame(int size) {
+    int bytes = SizeClassAllocator::alignUp(std::max(1, size));
+    if (bytes > kFrameBase + kFrameRegionBytes - frameTop)
+      throw ProgramError("Stack overflow: local arrays exceed " +
+                         llvm::Twine(kFrameRegionBytes) + " bytes");
+    int addr = frameTop;
+    frameTop += bytes;
+    size_t used = frameTop - kFrameBase;
+    if (frames.size() < used) frames.resize(used);
+    std::memset(&frames[addr - kFrameBase], 0, bytes);
+    stats.peakFrameBytes = std::max<int64_t>(stats.peakFrameBytes, used);
+    return addr;
+  }
+  /// Release every frame block allocated since mark was taken
+  void releaseFrame(int mark) {
+    assert(mark <= frameTop && "frame released out of order");
+    frameTop = mark;
+  }
+  /// Release a block; like free(NULL), FREE of address 0 does nothing
+  void Free(int itemIdx) {
+    if (itemIdx == 0) return;
+    auto it = blocks.find(itemIdx);
+    if (it == blocks.end())
+      throw ProgramError("FREE of address " + llvm::Twine(itemIdx) +
+                         ", which MALLOC did not return");
+    allocator.release(itemIdx, it->second);
+    stats.frees++;
+    stats.liveBytes -= it->second;
+    blocks.erase(it);
+  }
+  void Store(int addr, int access, int val) {
+    char* p = locate(addr, access);
+    switch (access < 0 ? -access : access) {
+      case 1: {
+        int8_t v = val;
+        std::memcpy(p, &v, 1);
+        break;
+      }
+      case 2: {
+        int16_t v = val;
+        std::memcpy(p, &v, 2);
+        break;
+      }
+      case 8: {
+        int64_t v = access < 0 ? (int64_t)(uint32_t)val : (int64_t)val;
+        std::memcpy(p, &v, 8);
+        break;
+      }
+      default:
+        std::memcpy(p, &val, sizeof(int));
+    }
+  }
+  int Load(int addr, int access) {
+    const char* p = locate(addr, access);
+    switch (access) {
+      case 1: {
+        int8_t v;
+        std::memcpy(&v, p, 1);
+        return v;
+      }
+      case -1: {
+        uint8_t v;
+        std::memcpy(&v, p, 1);
+        return v;
+      }
+      case 2: {
+        int16_t v;
+        std::memcpy(&v, p, 2);
+        return v;
+      }
+      case -2: {
+        uint16_t v;
+        std::memcpy(&v, p, 2);
+        return v;
+      }
+      case 8:
+      case -8: {
+        int64_t v;
+        std::memcpy(&v, p, 8);
+        return (int)v;
+      }
+      default: {
+        int v;
+        std::memcpy(&v, p, sizeof(int));
+        return v;
+      }
+    }
+  }
+
+  /// val wrapped to the integer type of access, the value a store and a
+  /// load of that type leave
+  static int truncate(int val, int access) {
+    switch (access) {
+      case 1:
+        return (int8_t)val;
+      case -1:
+        return (uint8_t)val;
+      case 2:
+        return (int16_t)val;
+      case -2:
+        return (uint16_t)val;
+      default:
+        return val;
+    }
+  }
+
+  const Stats& getStats() const { return stats; }
+  void printStats(llvm::raw_ostream& os) const {
+    os << "heap mallocs: " << stats.mallocs << "\n"
+       << "heap frees: " << stats.frees << "\n"
+       << "heap reused blocks: " << stats.reused << "\n"
+       << "heap live bytes: " << stats.liveBytes << "\n"
+       << "heap peak live bytes: " << stats.peakLiveBytes << "\n"
+       << "heap arena bytes: " << stats.arenaBytes << "\n"
+       << "heap peak frame bytes: " << stats.peakFrameBytes << "\n";
+  }
+};
+
+#endif
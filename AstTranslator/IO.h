@@ -0,0 +1,150 @@
+//==--- IO.h - Buffered GET and PRINT of a program ------------------------===//
+#ifndef __IO_H
+#define __IO_H
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+/// Buffered I/O behind the GET and PRINT builtins. PRINT formats into a
+/// large buffer that is written when full and on flush, GET parses integers
+/// straight out of chunks read from the input descriptor. Each engine
+/// instance owns one, so several programs can run side by side. A program
+/// that runs into an error still shows what it printed before: whoever
+/// catches the ProgramError flushes the instance of that program only.
+class ProgramIO {
+  static const size_t BufferSize = 1 << 16;
+
+  int mOutFd;
+  bool mOwnsOutFd;
+  std::vector<char> mOut;
+  size_t mOutLen;
+
+  int mInFd;
+  std::vector<char> mIn;
+  size_t mInPos;
+  size_t mInLen;
+  bool mInEof;
+
+ public:
+  ProgramIO()
+      : mOutFd(STDERR_FILENO),
+        mOwnsOutFd(false),
+        mOut(BufferSize),
+        mOutLen(0),
+        mInFd(STDIN_FILENO),
+        mIn(BufferSize),
+        mInPos(0),
+        mInLen(0),
+        mInEof(false) {}
+  ~ProgramIO() {
+    flush();
+    if (mOwnsOutFd) close(mOutFd);
+  }
+  ProgramIO(const ProgramIO&) = delete;
+  ProgramIO& operator=(const ProgramIO&) = delete;
+
+  /// Send PRINT output to "stderr" (the default), "stdout" or a file,
+  /// which is truncated. Returns false if the file cannot be opened.
+  bool setOutput(llvm::StringRef target) {
+    flush();
+    int fd;
+    if (target == "stderr") {
+      fd = STDERR_FILENO;
+    } else if (target == "stdout") {
+      fd = STDOUT_FILENO;
+    } else {
+      fd = open(target.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0) return false;
+    }
+    if (mOwnsOutFd) close(mOutFd);
+    mOutFd = fd;
+    mOwnsOutFd = fd != STDERR_FILENO && fd != STDOUT_FILENO;
+    return true;
+  }
+  /// Read GET input from fd instead of stdin
+  void setInput(int fd) {
+    mInFd = fd;
+    mInPos = mInLen = 0;
+    mInEof = false;
+  }
+
+  void print(int val) {
+    if (mOutLen + 16 > mOut.size()) flush();
+    char digits[16];
+    int n = 0;
+    unsigned uval = val < 0 ? 0u - (unsigned)val : (unsigned)val;
+    do {
+      digits[n++] = '0' + uval % 10;
+      uval /= 10;
+    } while (uval);
+    if (val < 0) mOut[mOutLen++] = '-';
+    while (n) mOut[mOutLen++] = digits[--n];
+  }
+
+  /// Parse the next integer like scanf("%d"). Yields 0 at end of input or
+  /// when the input does not start with a number.
+  int get() {
+    int c = peek();
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+           c == '\f') {
+      mInPos++;
+      c = peek();
+    }
+    bool negative = false;
+    if (c == '-' || c == '+') {
+      negative = c == '-';
+      mInPos++;
+      c = peek();
+    }
+    unsigned val = 0;
+    while (c >= '0' && c <= '9') {
+      val = val * 10 + (c - '0');
+      mInPos++;
+      c = peek();
+    }
+    return negative ? (int)(0u - val) : (int)val;
+  }
+
+  void flush() {
+    size_t done = 0;
+    while (done < mOutLen) {
+      ssize_t n = write(mOutFd, mOut.data() + done, mOutLen - done);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      done += n;
+    }
+    mOutLen = 0;
+  }
+
+ private:
+  /// The next input character without consuming it, -1 at end of input
+  int peek() {
+    if (mInPos == mInLen && !refill()) return -1;
+    return (unsigned char)mIn[mInPos];
+  }
+  bool refill() {
+    if (mInEof) return false;
+    // Whatever was printed so far should be visible before blocking on input
+    flush();
+    while (true) {
+      ssize_t n = read(mInFd, mIn.data(), mIn.size());
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        mInEof = true;
+        return false;
+      }
+      mInPos = 0;
+      mInLen = n;
+      return true;
+    }
+  }
+};
+
+#endif
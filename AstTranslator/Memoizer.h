@@ -0,0 +1,160 @@
+//==--- Memoizer.h - Caching of calls to pure functions -------------------===//
+#ifndef __MEMOIZER_H
+#define __MEMOIZER_H
+#include <cstdint>
+#include <vector>
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Stmt.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+/// Finds the user functions whose result depends only on their argument
+/// values: they never load or store through the Heap, read or write a
+/// global, call a builtin, declare a local array or call anything that is
+/// not pure itself. Calling such a function again with the same arguments
+/// can reuse the earlier result.
+class PurityAnalysis {
+  llvm::DenseSet<const FunctionDecl*> mPure;
+
+ public:
+  void build(TranslationUnitDecl* unit) {
+    // Start from the functions that are pure on their own, then drop the
+    // ones that call an impure function until nothing changes
+    llvm::DenseMap<const FunctionDecl*, std::vector<const FunctionDecl*>>
+        callees;
+    for (Decl* decl : unit->decls()) {
+      FunctionDecl* fdecl = dyn_cast<FunctionDecl>(decl);
+      if (!fdecl || !fdecl->isThisDeclarationADefinition()) continue;
+      std::vector<const FunctionDecl*>& fnCallees = callees[fdecl];
+      if (isLocallyPure(fdecl->getBody(), fnCallees)) mPure.insert(fdecl);
+    }
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto& entry : callees) {
+        if (!mPure.count(entry.first)) continue;
+        for (const FunctionDecl* callee : entry.second) {
+          if (!mPure.count(callee)) {
+            mPure.erase(entry.first);
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  bool isPure(const FunctionDecl* definition) const {
+    return mPure.count(definition);
+  }
+
+ private:
+  /// Whether stmt stays clear of the Heap, globals and builtins. The
+  /// definitions it calls are collected for the caller to check.
+  static bool isLocallyPure(Stmt* stmt,
+                            std::vector<const FunctionDecl*>& callees) {
+    if (!stmt) return true;
+    if (CallExpr* callexpr = dyn_cast<CallExpr>(stmt)) {
+      FunctionDecl* callee = callexpr->getDirectCallee();
+      // Builtins are only declared, so they are caught here too
+      if (!callee || !callee->getDefinition()) return false;
+      callees.push_back(callee->getDefinition());
+    } else if (DeclRefExpr* declexpr = dyn_cast<DeclRefExpr>(stmt)) {
+      if (VarDecl* vardecl = dyn_cast<VarDecl>(declexpr->getDecl()))
+        if (vardecl->hasGlobalStorage()) return false;
+    } else if (UnaryOperator* uop = dyn_cast<UnaryOperator>(stmt)) {
+      if (uop->getOpcode() == UO_Deref || uop->getOpcode() == UO_AddrOf)
+        return false;
+    } else if (isa<ArraySubscriptExpr>(stmt)) {
+      return false;
+    } else if (DeclStmt* declstmt = dyn_cast<DeclStmt>(stmt)) {
+      for (Decl* decl : declstmt->decls()) {
+        VarDecl* vardecl = dyn_cast<VarDecl>(decl);
+        if (!vardecl || vardecl->hasGlobalStorage() ||
+            vardecl->getType()->isArrayType())
+          return false;
+      }
+    }
+    for (Stmt* child : stmt->children()) {
+      if (!isLocallyPure(child, callees)) return false;
+    }
+    return true;
+  }
+};
+
+/// Bounded cache of the results of pure calls, keyed by the callee and its
+/// argument values. It is direct mapped: a colliding call simply replaces
+/// the older entry, so memory stays fixed however many distinct calls a
+/// program makes.
+class MemoCache {
+ public:
+  /// Functions with more parameters are not memoized
+  static const unsigned kMaxArgs = 4;
+
+ private:
+  static const unsigned kLogEntries = 16;
+  static const unsigned kNumEntries = 1 << kLogEntries;
+
+  struct Entry {
+    const FunctionDecl* callee;
+    int args[kMaxArgs];
+    int result;
+  };
+  std::vector<Entry> mEntries;
+  uint64_t mHits;
+  uint64_t mMisses;
+
+  static unsigned hash(const FunctionDecl* callee, const int* args,
+                       unsigned numArgs) {
+    uint64_t h = reinterpret_cast<uintptr_t>(callee) >> 4;
+    for (unsigned i = 0; i < numArgs; i++) {
+      h = (h ^ (uint32_t)args[i]) * 0x9e3779b97f4a7c15ULL;
+    }
+    // Fibonacci hashing: the top bits of the product are the best mixed
+    return h >> (64 - kLogEntries);
+  }
+  static bool sameArgs(const Entry& entry, const int* args,
+                       unsigned numArgs) {
+    for (unsigned i = 0; i < numArgs; i++) {
+      if (entry.args[i] != args[i]) return false;
+    }
+    return true;
+  }
+
+ public:
+  MemoCache() : mEntries(kNumEntries), mHits(0), mMisses(0) {
+    for (Entry& entry : mEntries) entry.callee = NULL;
+  }
+
+  bool lookup(const FunctionDecl* callee, const int* args, unsigned numArgs,
+              int& result) {
+    const Entry& entry = mEntries[hash(callee, args, numArgs)];
+    if (entry.callee == callee && sameArgs(entry, args, numArgs)) {
+      mHits++;
+      result = entry.result;
+      return true;
+    }
+    mMisses++;
+    return false;
+  }
+  void insert(const FunctionDecl* callee, const int* args, unsigned numArgs,
+              int result) {
+    Entry& entry = mEntries[hash(callee, args, numArgs)];
+    entry.callee = callee;
+    for (unsigned i = 0; i < numArgs; i++) entry.args[i] = args[i];
+    entry.result = result;
+  }
+
+  void printStats(llvm::raw_ostream& os) const {
+    os << "memo hits: " << mHits << "\n"
+       << "memo misses: " << mMisses << "\n";
+  }
+};
+
+#endif
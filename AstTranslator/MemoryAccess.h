@@ -0,0 +1,108 @@
+//==--- MemoryAccess.h - Types of accesses to the heap --------------------===//
+#ifndef __MEMORYACCESS_H
+#define __MEMORYACCESS_H
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Type.h"
+
+using namespace clang;
+
+/// Heap memory is byte addressed. These helpers turn the type of an access
+/// into what the engines need: the access code Heap::Load and Heap::Store
+/// take, and the scale of subscripts and pointer arithmetic. The engines
+/// share them so they agree on every access.
+
+/// Access code of a load or store of type: its width in bytes (1, 2, 4 or
+/// 8), negated when a narrower value is zero extended to an int
+inline int getAccessCode(const ASTContext& context, QualType type) {
+  if (!type->isIntegerType() && !type->isPointerType()) return sizeof(int);
+  int width = context.getTypeSizeInChars(type).getQuantity();
+  if (width != 1 && width != 2 && width != 4 && width != 8)
+    width = sizeof(int);
+  return type->isUnsignedIntegerType() ? -width : width;
+}
+
+/// What a cast does to the int that holds its operand's value
+enum CastConversion {
+  /// Nothing: the value already fits, or only its type changes
+  CastKeep,
+  /// Wrap it to a narrower integer type, see Heap::truncate
+  CastTruncate,
+  /// Normalize it to 0 or 1
+  CastToBool
+};
+
+/// Conversion that castexpr applies. For CastTruncate, access is set to the
+/// access code of the narrower type.
+inline CastConversion getCastConversion(const ASTContext& context,
+                                        const CastExpr* castexpr,
+                                        int& access) {
+  switch (castexpr->getCastKind()) {
+    case CK_IntegralToBoolean:
+    case CK_PointerToBoolean:
+      return CastToBool;
+    case CK_IntegralCast:
+      access = getAccessCode(context, castexpr->getType());
+      if (castexpr->getType()->isBooleanType()) return CastToBool;
+      return access >= -2 && access <= 2 ? CastTruncate : CastKeep;
+    default:
+      return CastKeep;
+  }
+}
+
+/// Bytes a variable of type takes, e.g. all elements of an array
+inline int getAllocSize(const ASTContext& context, QualType type) {
+  return context.getTypeSizeInChars(type).getQuantity();
+}
+
+/// Bytes one step of pointer arithmetic on a pointer or array of type moves
+inline int getPointeeSize(const ASTContext& context, QualType type) {
+  QualType pointee;
+  if (const PointerType* pointerType = type->getAs<PointerType>())
+    pointee = pointerType->getPointeeType();
+  else if (const ArrayType* arrayType = type->getAsArrayTypeUnsafe())
+    pointee = arrayType->getElementType();
+  // void * and function pointers step by one byte, as in GNU C
+  if (pointee.isNull() || pointee->isVoidType() || pointee->isFunctionType())
+    return 1;
+  return context.getTypeSizeInChars(pointee).getQuantity();
+}
+
+/// Bytes between the elements that subscript steps over
+inline int getElementSize(const ASTContext& context,
+                          const ArraySubscriptExpr* subscript) {
+  return getAllocSize(context, subscript->getType());
+}
+
+/// Whether reading an element of type loads it from the heap. An element
+/// that is itself an array is only its address.
+inline bool isLoadedElement(QualType type) { return !type->isArrayType(); }
+
+/// How an addition or subtraction scales its operands. Pointer arithmetic
+/// moves by whole elements of the pointee: the integer operand is
+/// multiplied by the element size, and the difference of two pointers is
+/// divided by it.
+struct PointerArith {
+  int leftScale;
+  int rightScale;
+  int divisor;
+};
+
+/// Scaling of bop, all ones unless it is an addition or subtraction
+/// involving a pointer
+inline PointerArith getPointerArith(const ASTContext& context,
+                                    const BinaryOperator* bop) {
+  PointerArith arith = {1, 1, 1};
+  if (!bop->isAdditiveOp()) return arith;
+  QualType leftType = bop->getLHS()->getType();
+  QualType rightType = bop->getRHS()->getType();
+  if (leftType->isPointerType() && rightType->isPointerType())
+    arith.divisor = getPointeeSize(context, leftType);
+  else if (leftType->isPointerType())
+    arith.rightScale = getPointeeSize(context, leftType);
+  else if (rightType->isPointerType())
+    arith.leftScale = getPointeeSize(context, rightType);
+  return arith;
+}
+
+#endif
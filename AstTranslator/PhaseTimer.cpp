@@ -0,0 +1,92 @@
+//==--- PhaseTimer.cpp - Process wide allocation counter ------------------===//
+#include "PhaseTimer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "llvm/Support/ErrorHandling.h"
+
+#ifdef ENABLE_ALLOC_COUNTING
+// Replacing the global allocation functions is the only portable way to
+// count allocations of the whole process, Clang's included. The count is a
+// relaxed atomic, batch mode allocates from several threads. The
+// replacement stays in every run once built in, hence the build option.
+static std::atomic<uint64_t> gAllocations(0);
+
+uint64_t getAllocationCount() {
+  return gAllocations.load(std::memory_order_relaxed);
+}
+
+static void* allocate(size_t size, size_t align) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (!size) size = 1;
+  if (align <= alignof(std::max_align_t)) return std::malloc(size);
+  void* ptr;
+  if (align < sizeof(void*)) align = sizeof(void*);
+  return posix_memalign(&ptr, align, size) == 0 ? ptr : NULL;
+}
+
+void* operator new(size_t size) {
+  void* ptr = allocate(size, 0);
+  if (!ptr) llvm::report_bad_alloc_error("Allocation failed");
+  return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size, 0);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+void* operator new(size_t size, std::align_val_t align) {
+  void* ptr = allocate(size, (size_t)align);
+  if (!ptr) llvm::report_bad_alloc_error("Allocation failed");
+  return ptr;
+}
+void* operator new[](size_t size, std::align_val_t align) {
+  return operator new(size, align);
+}
+void* operator new(size_t size, std::align_val_t align,
+                   const std::nothrow_t&) noexcept {
+  return allocate(size, (size_t)align);
+}
+void* operator new[](size_t size, std::align_val_t align,
+                     const std::nothrow_t& tag) noexcept {
+  return operator new(size, align, tag);
+}
+// Both malloc and posix_memalign memory is released with free
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  std::free(ptr);
+}
+#else
+uint64_t getAllocationCount() { return 0; }
+#endif
@@ -0,0 +1,117 @@
+//==--- PhaseTimer.h - Wall time and memory per phase of a run ------------===//
+#ifndef __PHASETIMER_H
+#define __PHASETIMER_H
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// Number of operator new calls so far in the whole process, counted by
+/// the replacement operators in PhaseTimer.cpp. Always 0 unless built with
+/// ENABLE_ALLOC_COUNTING.
+uint64_t getAllocationCount();
+
+/// Splits a run into consecutive phases and records the wall time, the
+/// allocations and the growth of the peak resident memory of each, next to
+/// named counters the engines report. ru_maxrss is the high-water mark of
+/// the whole process, so a phase is charged only for raising it: a phase
+/// that reuses memory freed by an earlier one shows 0. Exactly one phase
+/// is running between start and finish; starting a phase ends the previous
+/// one.
+class PhaseTimer {
+  typedef std::chrono::steady_clock Clock;
+
+  struct Phase {
+    std::string name;
+    Clock::duration wall;
+    uint64_t allocations;
+    /// How much the phase raised the process high-water mark
+    long rssGrowthKiB;
+  };
+  struct Counter {
+    std::string name;
+    uint64_t value;
+  };
+
+  std::vector<Phase> mPhases;
+  std::vector<Counter> mCounters;
+  bool mRunning;
+  Clock::time_point mStart;
+  uint64_t mStartAllocations;
+  long mStartRSSKiB;
+
+ public:
+  PhaseTimer() : mRunning(false), mStartAllocations(0), mStartRSSKiB(0) {}
+
+  void start(const std::string& name) {
+    finish();
+    Phase phase = {name, Clock::duration::zero(), 0, 0};
+    mPhases.push_back(phase);
+    mRunning = true;
+    mStartAllocations = getAllocationCount();
+    mStartRSSKiB = getPeakRSSKiB();
+    mStart = Clock::now();
+  }
+  /// End the running phase, if any
+  void finish() {
+    if (!mRunning) return;
+    Phase& phase = mPhases.back();
+    phase.wall = Clock::now() - mStart;
+    phase.allocations = getAllocationCount() - mStartAllocations;
+    phase.rssGrowthKiB = getPeakRSSKiB() - mStartRSSKiB;
+    mRunning = false;
+  }
+  /// Forget every phase and counter, e.g. in a fork server child that only
+  /// reports its own request
+  void reset() {
+    mPhases.clear();
+    mCounters.clear();
+    mRunning = false;
+  }
+  /// Record a value measured by an engine, such as its heap statistics
+  void count(const std::string& name, uint64_t value) {
+    Counter counter = {name, value};
+    mCounters.push_back(counter);
+  }
+
+  void printReport(llvm::raw_ostream& os) {
+    finish();
+    os << "phase                 wall ms   allocations  rss +KiB\n";
+    Clock::duration total = Clock::duration::zero();
+    for (const Phase& phase : mPhases) {
+#ifdef ENABLE_ALLOC_COUNTING
+      os << llvm::format("%-16s  %11.3f  %12llu  %8ld\n",
+                         phase.name.c_str(), toMillis(phase.wall),
+                         (unsigned long long)phase.allocations,
+                         phase.rssGrowthKiB);
+#else
+      os << llvm::format("%-16s  %11.3f             -  %8ld\n",
+                         phase.name.c_str(), toMillis(phase.wall),
+                         phase.rssGrowthKiB);
+#endif
+      total += phase.wall;
+    }
+    os << llvm::format("total             %11.3f\n", toMillis(total));
+    os << "peak rss KiB: " << getPeakRSSKiB() << "\n";
+    for (const Counter& counter : mCounters) {
+      os << counter.name << ": " << counter.value << "\n";
+    }
+  }
+
+ private:
+  /// High-water mark of the resident memory of the process so far
+  static long getPeakRSSKiB() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+  }
+  static double toMillis(Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  }
+};
+
+#endif
@@ -0,0 +1,131 @@
+//==--- Profiler.h - Per statement and call profile -----------------------===//
+#ifndef __PROFILER_H
+#define __PROFILER_H
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/Stmt.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+/// Counts executions and wall time of the statements of compound
+/// statements and of function bodies run by the AST engine. Total time is
+/// inclusive and taken from the outermost activation only, so recursion is
+/// not counted twice; self time leaves out nested statements and calls.
+class StmtProfiler {
+  typedef std::chrono::steady_clock Clock;
+
+  struct Record {
+    /// Either a Stmt or a FunctionDecl
+    const void* key;
+    bool isFunction;
+    SourceLocation loc;
+    unsigned long long count;
+    Clock::duration total;
+    Clock::duration self;
+    /// Activations currently on the profile stack
+    unsigned active;
+  };
+  struct Activation {
+    unsigned record;
+    Clock::time_point start;
+    Clock::duration children;
+  };
+
+  const SourceManager& mSourceManager;
+  llvm::DenseMap<const void*, unsigned> mIndex;
+  std::vector<Record> mRecords;
+  std::vector<Activation> mActive;
+
+ public:
+  explicit StmtProfiler(const SourceManager& sourceManager)
+      : mSourceManager(sourceManager) {}
+
+  /// Brackets one execution of a statement or function body
+  class Scope {
+    StmtProfiler& mProfiler;
+
+   public:
+    Scope(StmtProfiler& profiler, const Stmt* stmt) : mProfiler(profiler) {
+      mProfiler.enter(stmt, false, stmt->getBeginLoc());
+    }
+    Scope(StmtProfiler& profiler, const FunctionDecl* fdecl)
+        : mProfiler(profiler) {
+      mProfiler.enter(fdecl, true, fdecl->getLocation());
+    }
+    ~Scope() { mProfiler.leave(); }
+  };
+
+  /// Write the functions and then the statements, hottest self time first
+  void printReport(llvm::raw_ostream& os) {
+    std::vector<const Record*> sorted;
+    for (const Record& record : mRecords) sorted.push_back(&record);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Record* a, const Record* b) {
+                       return a->self > b->self;
+                     });
+    os << "profile: functions\n";
+    os << "     calls    total ms     self ms  line  function\n";
+    for (const Record* record : sorted) {
+      if (!record->isFunction) continue;
+      printRecord(os, *record,
+                  static_cast<const FunctionDecl*>(record->key)
+                      ->getNameAsString());
+    }
+    os << "profile: statements\n";
+    os << "     count    total ms     self ms  line  statement\n";
+    for (const Record* record : sorted) {
+      if (record->isFunction) continue;
+      printRecord(os, *record,
+                  static_cast<const Stmt*>(record->key)->getStmtClassName());
+    }
+  }
+
+ private:
+  void enter(const void* key, bool isFunction, SourceLocation loc) {
+    auto it = mIndex.find(key);
+    unsigned index;
+    if (it == mIndex.end()) {
+      index = mRecords.size();
+      mIndex[key] = index;
+      Record record = {key, isFunction, loc, 0, Clock::duration::zero(),
+                       Clock::duration::zero(), 0};
+      mRecords.push_back(record);
+    } else {
+      index = it->second;
+    }
+    mRecords[index].count++;
+    mRecords[index].active++;
+    Activation activation = {index, Clock::now(), Clock::duration::zero()};
+    mActive.push_back(activation);
+  }
+  void leave() {
+    Activation activation = mActive.back();
+    mActive.pop_back();
+    Clock::duration elapsed = Clock::now() - activation.start;
+    Record& record = mRecords[activation.record];
+    if (--record.active == 0) record.total += elapsed;
+    record.self += elapsed - activation.children;
+    if (!mActive.empty()) mActive.back().children += elapsed;
+  }
+
+  void printRecord(llvm::raw_ostream& os, const Record& record,
+                   const std::string& name) {
+    unsigned line = mSourceManager.getPresumedLineNumber(record.loc);
+    os << llvm::format("%10llu  %10.3f  %10.3f  %4u  ", record.count,
+                       toMillis(record.total), toMillis(record.self), line)
+       << name << "\n";
+  }
+  static double toMillis(Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  }
+};
+
+#endif
@@ -0,0 +1,28 @@
+//==--- ProgramError.h - Errors that end one interpreted program ----------===//
+#ifndef __PROGRAMERROR_H
+#define __PROGRAMERROR_H
+#include <climits>
+#include <stdexcept>
+
+#include "llvm/ADT/Twine.h"
+
+/// An error that ends the interpreted program: an unsupported construct,
+/// a call to an undefined function, running out of heap or stack. Engines
+/// throw it instead of exiting, and whoever runs the program catches it,
+/// flushes what the program printed and reports the message, so in batch
+/// mode only that one job fails. It never crosses Clang's frames: the
+/// consumer catches it inside HandleTranslationUnit.
+class ProgramError : public std::runtime_error {
+ public:
+  explicit ProgramError(const llvm::Twine& message)
+      : std::runtime_error(message.str()) {}
+};
+
+/// Reject the operands of an int division or remainder that the host CPU
+/// would trap on, as a native run of the program would
+inline void checkDivision(int left, int right) {
+  if (right == 0) throw ProgramError("Division by zero");
+  if (right == -1 && left == INT_MIN) throw ProgramError("Division overflow");
+}
+
+#endif
@@ -0,0 +1,87 @@
+//==--- Sampler.h - Signal driven sampling of the call stack --------------===//
+#ifndef __SAMPLER_H
+#define __SAMPLER_H
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "llvm/Support/raw_ostream.h"
+
+/// Statistical profiler for the AST engine. A SIGPROF interval timer only
+/// counts pending samples; the interpreter takes them at its next
+/// statement boundary, where walking the frame stack is safe, and adds the
+/// interpreted call stack to a table of collapsed stacks. The table is
+/// written in the "frame;frame;frame count" format that flamegraph.pl and
+/// speedscope read. Costs one load per statement between samples.
+class StackSampler {
+  std::map<std::string, uint64_t> mStacks;
+  struct itimerval mOldTimer;
+  struct sigaction mOldAction;
+
+  /// Written by the signal handler, so it has to be lock free; taking the
+  /// samples swaps in zero in one step, so none that arrive meanwhile are
+  /// lost
+  static std::atomic<unsigned>& pendingSamples() {
+    static_assert(ATOMIC_INT_LOCK_FREE == 2, "signal handler needs it");
+    static std::atomic<unsigned> pending(0);
+    return pending;
+  }
+  static void onSignal(int) {
+    pendingSamples().fetch_add(1, std::memory_order_relaxed);
+  }
+
+ public:
+  /// Start sampling the CPU time of the process hz times a second. The
+  /// signal is unblocked in the calling thread, which should be the one
+  /// that interprets; other threads are expected to block SIGPROF.
+  explicit StackSampler(unsigned hz) {
+    struct sigaction action;
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, &mOldAction);
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+    long micros = 1000000 / (hz ? hz : 1);
+    if (micros < 1) micros = 1;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = micros / 1000000;
+    timer.it_interval.tv_usec = micros % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, &mOldTimer);
+  }
+  ~StackSampler() {
+    setitimer(ITIMER_PROF, &mOldTimer, NULL);
+    sigaction(SIGPROF, &mOldAction, NULL);
+  }
+  StackSampler(const StackSampler&) = delete;
+  StackSampler& operator=(const StackSampler&) = delete;
+
+  bool hasPending() const {
+    return pendingSamples().load(std::memory_order_relaxed) != 0;
+  }
+  /// Take the samples that arrived since the last call
+  unsigned takePending() {
+    return pendingSamples().exchange(0, std::memory_order_relaxed);
+  }
+  /// Account count samples to stack, outermost frame first
+  void add(const std::string& stack, unsigned count) {
+    mStacks[stack] += count;
+  }
+
+  void writeCollapsed(llvm::raw_ostream& os) const {
+    for (const auto& entry : mStacks) {
+      os << entry.first << " " << entry.second << "\n";
+    }
+  }
+};
+
+#endif
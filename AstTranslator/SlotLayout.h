@@ -0,0 +1,134 @@
+//==--- SlotLayout.h - Dense slots for variables and expressions ----------===//
+#ifndef __SLOTLAYOUT_H
+#define __SLOTLAYOUT_H
+#include <cassert>
+
+#include "MemoryAccess.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/AST/Stmt.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Casting.h"
+
+using namespace clang;
+
+/// Where a variable lives: an index into the globals or into the frame of
+/// the function that declares it. A local array also has storage at
+/// arrayOffset in its frame's array block.
+struct VarSlot {
+  bool isGlobal;
+  unsigned index;
+  unsigned arrayOffset;
+  VarSlot() : isGlobal(false), index(0), arrayOffset(0) {}
+  VarSlot(bool _isGlobal, unsigned _index)
+      : isGlobal(_isGlobal), index(_index), arrayOffset(0) {}
+};
+
+/// Pre-pass that gives every global, parameter and local a dense slot, so
+/// frames and the global region can be flat arrays. Parameters take slots
+/// [0, numParams) of their function, locals follow in declaration order.
+/// The local arrays of a function are packed into one block that a call
+/// takes from the Heap frame region on entry and releases on return.
+/// Every expression also gets a slot for its value in the frame that
+/// evaluates it: its function's, or the one running the global
+/// initializers.
+class SlotLayout {
+  llvm::DenseMap<const Decl*, VarSlot> mSlots;
+  llvm::DenseMap<const FunctionDecl*, unsigned> mFrameSizes;
+  llvm::DenseMap<const FunctionDecl*, unsigned> mArrayBytes;
+  llvm::DenseMap<const Stmt*, unsigned> mExprSlots;
+  llvm::DenseMap<const FunctionDecl*, unsigned> mNumExprs;
+  unsigned mNumGlobals;
+  unsigned mNumInitExprs;
+
+ public:
+  SlotLayout() : mNumGlobals(0), mNumInitExprs(0) {}
+
+  void build(TranslationUnitDecl* unit) {
+    const ASTContext& context = unit->getASTContext();
+    for (TranslationUnitDecl::decl_iterator i = unit->decls_begin(),
+                                            e = unit->decls_end();
+         i != e; ++i) {
+      if (FunctionDecl* fdecl = dyn_cast<FunctionDecl>(*i)) {
+        if (!fdecl->isThisDeclarationADefinition()) continue;
+        unsigned numSlots = 0;
+        for (unsigned p = 0; p < fdecl->getNumParams(); p++) {
+          mSlots[fdecl->getParamDecl(p)] = VarSlot(false, numSlots++);
+        }
+        unsigned arrayBytes = 0;
+        collectLocals(context, fdecl->getBody(), numSlots, arrayBytes);
+        mFrameSizes[fdecl] = numSlots;
+        mArrayBytes[fdecl] = arrayBytes;
+        unsigned numExprs = 0;
+        collectExprs(fdecl->getBody(), numExprs);
+        mNumExprs[fdecl] = numExprs;
+      } else if (VarDecl* vdecl = dyn_cast<VarDecl>(*i)) {
+        mSlots[vdecl] = VarSlot(true, mNumGlobals++);
+        collectExprs(vdecl->getInit(), mNumInitExprs);
+      }
+    }
+  }
+
+  bool lookup(const Decl* decl, VarSlot& slot) const {
+    auto it = mSlots.find(decl);
+    if (it == mSlots.end()) return false;
+    slot = it->second;
+    return true;
+  }
+  /// Number of slots a frame of the given function definition needs
+  unsigned getFrameSize(const FunctionDecl* fdecl) const {
+    auto it = mFrameSizes.find(fdecl);
+    return it == mFrameSizes.end() ? 0 : it->second;
+  }
+  /// Bytes of the block holding the local arrays of the function definition
+  unsigned getArrayBytes(const FunctionDecl* fdecl) const {
+    auto it = mArrayBytes.find(fdecl);
+    return it == mArrayBytes.end() ? 0 : it->second;
+  }
+  unsigned getNumGlobals() const { return mNumGlobals; }
+  /// Number of expression slots a frame of the function definition needs
+  unsigned getNumExprs(const FunctionDecl* fdecl) const {
+    auto it = mNumExprs.find(fdecl);
+    return it == mNumExprs.end() ? 0 : it->second;
+  }
+  /// Number of expression slots of the frame running global initializers
+  unsigned getNumInitExprs() const { return mNumInitExprs; }
+  /// Slot of expr's value in the frame that evaluates it
+  unsigned getExprSlot(const Stmt* expr) const {
+    auto it = mExprSlots.find(expr);
+    assert(it != mExprSlots.end() && "expression outside any function");
+    return it->second;
+  }
+
+ private:
+  void collectLocals(const ASTContext& context, Stmt* stmt,
+                     unsigned& numSlots, unsigned& arrayBytes) {
+    if (!stmt) return;
+    if (DeclStmt* declstmt = dyn_cast<DeclStmt>(stmt)) {
+      for (DeclStmt::decl_iterator it = declstmt->decl_begin(),
+                                   ie = declstmt->decl_end();
+           it != ie; ++it) {
+        VarDecl* vardecl = dyn_cast<VarDecl>(*it);
+        if (!vardecl || mSlots.find(vardecl) != mSlots.end()) continue;
+        VarSlot slot(false, numSlots++);
+        if (isa<ConstantArrayType>(vardecl->getType().getTypePtr())) {
+          // Keep every array 8 byte aligned, like Heap blocks
+          slot.arrayOffset = arrayBytes;
+          unsigned size = getAllocSize(context, vardecl->getType());
+          arrayBytes += (size + 7) / 8 * 8;
+        }
+        mSlots[vardecl] = slot;
+      }
+    }
+    for (Stmt* child : stmt->children())
+      collectLocals(context, child, numSlots, arrayBytes);
+  }
+  void collectExprs(Stmt* stmt, unsigned& numExprs) {
+    if (!stmt) return;
+    if (isa<Expr>(stmt)) mExprSlots[stmt] = numExprs++;
+    for (Stmt* child : stmt->children()) collectExprs(child, numExprs);
+  }
+};
+
+#endif
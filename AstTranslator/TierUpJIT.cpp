@@ -0,0 +1,767 @@
+//==--- TierUpJIT.cpp - LLVM compilation of hot functions -----------------===//
+#ifdef ENABLE_ORC_JIT
+#include "TierUpJIT.h"
+
+#include <climits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ProgramError.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Stmt.h"
+#include "clang/AST/Type.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Utils.h"
+
+/// Runtime callbacks the lowered code uses to reach the interpreter state
+extern "C" {
+static int astinterp_heap_get(JITRuntime* runtime, int addr, int access) {
+  return runtime->heap->Load(addr, access);
+}
+static void astinterp_heap_set(JITRuntime* runtime, int addr, int access,
+                               int val) {
+  runtime->heap->Store(addr, access, val);
+}
+static int astinterp_malloc(JITRuntime* runtime, int size) {
+  return runtime->heap->Malloc(size);
+}
+static void astinterp_free(JITRuntime* runtime, int addr) {
+  runtime->heap->Free(addr);
+}
+static int astinterp_alloc_frame(JITRuntime* runtime, int size) {
+  return runtime->heap->AllocFrame(size);
+}
+static void astinterp_release_frame(JITRuntime* runtime, int mark) {
+  runtime->heap->releaseFrame(mark);
+}
+static int astinterp_get(JITRuntime* runtime) { return runtime->io->get(); }
+static void astinterp_print(JITRuntime* runtime, int val) {
+  runtime->io->print(val);
+}
+/// Only reached for operands that make checkDivision throw
+static void astinterp_check_division(JITRuntime* runtime, int left,
+                                     int right) {
+  checkDivision(left, right);
+}
+}
+
+namespace {
+
+/// Lowers a function definition and every user function it can reach from
+/// the Clang AST to LLVM IR. The value model is the interpreter's: every
+/// value is an i32 and pointers are Heap addresses, so memory accesses go
+/// through the runtime callbacks.
+class IRLowering {
+  struct LoopContext {
+    llvm::BasicBlock* breakBB;
+    llvm::BasicBlock* continueBB;
+  };
+
+  const ASTContext& mContext;
+  const SlotLayout& mLayout;
+  FunctionDecl* mFree;
+  FunctionDecl* mMalloc;
+  FunctionDecl* mInput;
+  FunctionDecl* mOutput;
+  const std::set<const FunctionDecl*>& mAlreadyLowered;
+
+  llvm::LLVMContext& C;
+  llvm::Module& M;
+  llvm::IRBuilder<> B;
+  llvm::IntegerType* i32;
+  llvm::PointerType* i32Ptr;
+  llvm::PointerType* runtimePtr;
+
+  std::vector<FunctionDecl*> mWorklist;
+  std::set<const FunctionDecl*> mQueued;
+  bool mFailed;
+  /// The first construct the lowering gave up on
+  std::string mFailure;
+
+  // State of the function being lowered
+  llvm::Function* F;
+  llvm::Value* mRuntime;
+  llvm::Value* mGlobals;
+  std::vector<llvm::AllocaInst*> mSlots;
+  std::vector<LoopContext> mLoops;
+  /// Address of the function's local array block, if it has one
+  llvm::Value* mArrayBase;
+
+ public:
+  IRLowering(const ASTContext& context, const SlotLayout& layout,
+             FunctionDecl* freeDecl, FunctionDecl* mallocDecl,
+             FunctionDecl* inputDecl, FunctionDecl* outputDecl,
+             const std::set<const FunctionDecl*>& alreadyLowered,
+             llvm::Module& module)
+      : mContext(context),
+        mLayout(layout),
+        mFree(freeDecl),
+        mMalloc(mallocDecl),
+        mInput(inputDecl),
+        mOutput(outputDecl),
+        mAlreadyLowered(alreadyLowered),
+        C(module.getContext()),
+        M(module),
+        B(module.getContext()),
+        mFailed(false),
+        F(NULL),
+        mRuntime(NULL),
+        mGlobals(NULL),
+        mArrayBase(NULL) {
+    i32 = llvm::Type::getInt32Ty(C);
+    i32Ptr = llvm::Type::getInt32PtrTy(C);
+    runtimePtr = llvm::Type::getInt8PtrTy(C);
+  }
+
+  static std::string symbolName(const FunctionDecl* fdecl) {
+    return "astinterp." + fdecl->getNameAsString();
+  }
+  static std::string entryName(const FunctionDecl* fdecl) {
+    return symbolName(fdecl) + ".entry";
+  }
+
+  /// Lower root and its callees, then add the native entry wrapper of root.
+  /// Returns false if any of them uses an unsupported construct, which
+  /// getFailure then names.
+  bool lower(FunctionDecl* root, std::vector<const FunctionDecl*>& lowered) {
+    getFunction(root);
+    while (!mWorklist.empty() && !mFailed) {
+      FunctionDecl* fdecl = mWorklist.back();
+      mWorklist.pop_back();
+      lowerFunction(fdecl);
+      lowered.push_back(fdecl);
+    }
+    if (mFailed) return false;
+    lowerEntry(root);
+    for (llvm::Function& fn : M) {
+      if (!fn.isDeclaration() && llvm::verifyFunction(fn, &llvm::errs())) {
+        mFailure = "invalid IR for " + fn.getName().str();
+        return false;
+      }
+    }
+    return true;
+  }
+  const std::string& getFailure() const { return mFailure; }
+
+ private:
+  llvm::Function* getFunction(FunctionDecl* fdecl) {
+    std::string name = symbolName(fdecl);
+    if (llvm::Function* fn = M.getFunction(name)) return fn;
+    std::vector<llvm::Type*> params = {runtimePtr, i32Ptr};
+    params.resize(2 + fdecl->getNumParams(), i32);
+    llvm::Function* fn = llvm::Function::Create(
+        llvm::FunctionType::get(i32, params, false),
+        llvm::Function::ExternalLinkage, name, &M);
+    // ProgramErrors thrown by the runtime callbacks unwind through it
+    fn->addFnAttr(llvm::Attribute::UWTable);
+    if (!mAlreadyLowered.count(fdecl) && mQueued.insert(fdecl).second)
+      mWorklist.push_back(fdecl);
+    return fn;
+  }
+
+  llvm::FunctionCallee getRuntime(const char* name, llvm::Type* ret,
+                                  std::vector<llvm::Type*> params) {
+    params.insert(params.begin(), runtimePtr);
+    return M.getOrInsertFunction(name,
+                                 llvm::FunctionType::get(ret, params, false));
+  }
+
+  void lowerFunction(FunctionDecl* fdecl) {
+    F = getFunction(fdecl);
+    mLoops.clear();
+    B.SetInsertPoint(llvm::BasicBlock::Create(C, "entry", F));
+    llvm::Function::arg_iterator arg = F->arg_begin();
+    mRuntime = &*arg++;
+    mGlobals = &*arg++;
+    mSlots.clear();
+    for (unsigned i = 0; i < mLayout.getFrameSize(fdecl); i++) {
+      mSlots.push_back(B.CreateAlloca(i32));
+    }
+    for (unsigned i = 0; i < fdecl->getNumParams(); i++) {
+      B.CreateStore(&*arg++, mSlots[i]);
+    }
+    mArrayBase = NULL;
+    if (unsigned arrayBytes = mLayout.getArrayBytes(fdecl)) {
+      mArrayBase = B.CreateCall(
+          getRuntime("astinterp_alloc_frame", i32, {i32}),
+          {mRuntime, llvm::ConstantInt::get(i32, arrayBytes)});
+    }
+    lowerStmt(fdecl->getBody());
+    // Falling off the end, and the dead blocks after return, break and
+    // continue, return 0 like the interpreter
+    for (llvm::BasicBlock& bb : *F) {
+      if (!bb.getTerminator()) {
+        B.SetInsertPoint(&bb);
+        B.CreateRet(llvm::ConstantInt::get(i32, 0));
+      }
+    }
+    // The array block is released on every return, as in the interpreter
+    if (mArrayBase) {
+      for (llvm::BasicBlock& bb : *F) {
+        if (llvm::isa<llvm::ReturnInst>(bb.getTerminator())) {
+          B.SetInsertPoint(bb.getTerminator());
+          B.CreateCall(getRuntime("astinterp_release_frame",
+                                  llvm::Type::getVoidTy(C), {i32}),
+                       {mRuntime, mArrayBase});
+        }
+      }
+    }
+  }
+
+  void lowerEntry(FunctionDecl* fdecl) {
+    llvm::Function* target = getFunction(fdecl);
+    llvm::Function* entry = llvm::Function::Create(
+        llvm::FunctionType::get(i32, {runtimePtr, i32Ptr, i32Ptr}, false),
+        llvm::Function::ExternalLinkage, entryName(fdecl), &M);
+    entry->addFnAttr(llvm::Attribute::UWTable);
+    B.SetInsertPoint(llvm::BasicBlock::Create(C, "entry", entry));
+    llvm::Function::arg_iterator arg = entry->arg_begin();
+    llvm::Value* runtime = &*arg++;
+    llvm::Value* globals = &*arg++;
+    llvm::Value* args = &*arg++;
+    std::vector<llvm::Value*> callArgs = {runtime, globals};
+    for (unsigned i = 0; i < fdecl->getNumParams(); i++) {
+      llvm::Value* argAddr = B.CreateConstGEP1_32(i32, args, i);
+      callArgs.push_back(B.CreateLoad(i32, argAddr));
+    }
+    B.CreateRet(B.CreateCall(target, callArgs));
+  }
+
+  /// Give up on the whole lowering, remembering the first statement that
+  /// was not supported
+  void fail(Stmt* stmt) {
+    if (mFailed) return;
+    mFailed = true;
+    const SourceManager& sources = mContext.getSourceManager();
+    mFailure =
+        std::string(stmt->getStmtClassName()) + " at line " +
+        std::to_string(sources.getPresumedLineNumber(stmt->getBeginLoc()));
+  }
+  void branchIfOpen(llvm::BasicBlock* to) {
+    if (!B.GetInsertBlock()->getTerminator()) B.CreateBr(to);
+  }
+  /// Code after return, break and continue goes to an unreachable block
+  void startDeadBlock() {
+    B.SetInsertPoint(llvm::BasicBlock::Create(C, "dead", F));
+  }
+  llvm::BasicBlock* newBlock(const char* name) {
+    return llvm::BasicBlock::Create(C, name, F);
+  }
+  /// Branch to the runtime, which reports the error, when sdiv or srem
+  /// would trap on left and right
+  void guardDivision(llvm::Value* left, llvm::Value* right) {
+    llvm::Value* traps = B.CreateOr(
+        B.CreateICmpEQ(right, llvm::ConstantInt::get(i32, 0)),
+        B.CreateAnd(B.CreateICmpEQ(right, llvm::ConstantInt::get(i32, -1)),
+                    B.CreateICmpEQ(left, llvm::ConstantInt::get(
+                                             i32, INT_MIN, true))));
+    llvm::BasicBlock* errorBB = newBlock("div.error");
+    llvm::BasicBlock* okBB = newBlock("div.ok");
+    B.CreateCondBr(traps, errorBB, okBB);
+    B.SetInsertPoint(errorBB);
+    B.CreateCall(getRuntime("astinterp_check_division",
+                            llvm::Type::getVoidTy(C), {i32, i32}),
+                 {mRuntime, left, right});
+    B.CreateUnreachable();
+    B.SetInsertPoint(okBB);
+  }
+  llvm::Value* toBool(llvm::Value* val) {
+    return B.CreateICmpNE(val, llvm::ConstantInt::get(i32, 0));
+  }
+
+  void lowerStmt(Stmt* stmt) {
+    if (!stmt || mFailed) return;
+    if (CompoundStmt* compound = dyn_cast<CompoundStmt>(stmt)) {
+      for (Stmt* child : compound->body()) lowerStmt(child);
+    } else if (DeclStmt* declstmt = dyn_cast<DeclStmt>(stmt)) {
+      lowerDecl(declstmt);
+    } else if (IfStmt* ifstmt = dyn_cast<IfStmt>(stmt)) {
+      llvm::BasicBlock* thenBB = newBlock("if.then");
+      llvm::BasicBlock* elseBB = newBlock("if.else");
+      llvm::BasicBlock* endBB = newBlock("if.end");
+      B.CreateCondBr(toBool(lowerExpr(ifstmt->getCond())), thenBB, elseBB);
+      B.SetInsertPoint(thenBB);
+      lowerStmt(ifstmt->getThen());
+      branchIfOpen(endBB);
+      B.SetInsertPoint(elseBB);
+      lowerStmt(ifstmt->getElse());
+      branchIfOpen(endBB);
+      B.SetInsertPoint(endBB);
+    } else if (WhileStmt* whileStmt = dyn_cast<WhileStmt>(stmt)) {
+      llvm::BasicBlock* condBB = newBlock("while.cond");
+      llvm::BasicBlock* bodyBB = newBlock("while.body");
+      llvm::BasicBlock* endBB = newBlock("while.end");
+      B.CreateBr(condBB);
+      B.SetInsertPoint(condBB);
+      B.CreateCondBr(toBool(lowerExpr(whileStmt->getCond())), bodyBB, endBB);
+      B.SetInsertPoint(bodyBB);
+      lowerLoopBody(whileStmt->getBody(), endBB, condBB);
+      branchIfOpen(condBB);
+      B.SetInsertPoint(endBB);
+    } else if (DoStmt* doStmt = dyn_cast<DoStmt>(stmt)) {
+      llvm::BasicBlock* bodyBB = newBlock("do.body");
+      llvm::BasicBlock* condBB = newBlock("do.cond");
+      llvm::BasicBlock* endBB = newBlock("do.end");
+      B.CreateBr(bodyBB);
+      B.SetInsertPoint(bodyBB);
+      lowerLoopBody(doStmt->getBody(), endBB, condBB);
+      branchIfOpen(condBB);
+      B.SetInsertPoint(condBB);
+      B.CreateCondBr(toBool(lowerExpr(doStmt->getCond())), bodyBB, endBB);
+      B.SetInsertPoint(endBB);
+    } else if (ForStmt* forStmt = dyn_cast<ForStmt>(stmt)) {
+      lowerStmt(forStmt->getInit());
+      llvm::BasicBlock* condBB = newBlock("for.cond");
+      llvm::BasicBlock* bodyBB = newBlock("for.body");
+      llvm::BasicBlock* incBB = newBlock("for.inc");
+      llvm::BasicBlock* endBB = newBlock("for.end");
+      B.CreateBr(condBB);
+      B.SetInsertPoint(condBB);
+      if (Expr* cond = forStmt->getCond())
+        B.CreateCondBr(toBool(lowerExpr(cond)), bodyBB, endBB);
+      else
+        B.CreateBr(bodyBB);
+      B.SetInsertPoint(bodyBB);
+      lowerLoopBody(forStmt->getBody(), endBB, incBB);
+      branchIfOpen(incBB);
+      B.SetInsertPoint(incBB);
+      lowerStmt(forStmt->getInc());
+      B.CreateBr(condBB);
+      B.SetInsertPoint(endBB);
+    } else if (ReturnStmt* returnStmt = dyn_cast<ReturnStmt>(stmt)) {
+      if (Expr* expr = returnStmt->getRetValue())
+        B.CreateRet(lowerExpr(expr));
+      else
+        B.CreateRet(llvm::ConstantInt::get(i32, 0));
+      startDeadBlock();
+    } else if (isa<BreakStmt>(stmt) || isa<ContinueStmt>(stmt)) {
+      if (mLoops.empty()) return fail(stmt);
+      B.CreateBr(isa<BreakStmt>(stmt) ? mLoops.back().breakBB
+                                      : mLoops.back().continueBB);
+      startDeadBlock();
+    } else if (isa<NullStmt>(stmt)) {
+      // Nothing to do
+    } else if (Expr* expr = dyn_cast<Expr>(stmt)) {
+      lowerExpr(expr);
+    } else {
+      fail(stmt);
+    }
+  }
+
+  void lowerLoopBody(Stmt* body, llvm::BasicBlock* breakBB,
+                     llvm::BasicBlock* continueBB) {
+    LoopContext loop = {breakBB, continueBB};
+    mLoops.push_back(loop);
+    lowerStmt(body);
+    mLoops.pop_back();
+  }
+
+  void lowerDecl(DeclStmt* declstmt) {
+    for (DeclStmt::decl_iterator it = declstmt->decl_begin(),
+                                 ie = declstmt->decl_end();
+         it != ie; ++it) {
+      VarDecl* vardecl = dyn_cast<VarDecl>(*it);
+      VarSlot slot;
+      if (!vardecl || !mLayout.lookup(vardecl, slot) || slot.isGlobal)
+        return fail(declstmt);
+      llvm::Value* val;
+      if (isa<ConstantArrayType>(vardecl->getType().getTypePtr())) {
+        val = B.CreateAdd(mArrayBase,
+                          llvm::ConstantInt::get(i32, slot.arrayOffset));
+      } else if (vardecl->hasInit()) {
+        val = lowerExpr(vardecl->getInit());
+      } else {
+        val = llvm::ConstantInt::get(i32, 0);
+      }
+      B.CreateStore(val, mSlots[slot.index]);
+    }
+  }
+
+  llvm::Value* lowerExpr(Expr* expr) {
+    llvm::Value* zero = llvm::ConstantInt::get(i32, 0);
+    if (mFailed) return zero;
+    if (expr->getType()->isIntegerType()) {
+      Expr::EvalResult result;
+      if (expr->EvaluateAsInt(result, mContext))
+        return llvm::ConstantInt::get(i32, result.Val.getInt().getExtValue(),
+                                      true);
+    }
+    if (ParenExpr* parenExpr = dyn_cast<ParenExpr>(expr)) {
+      return lowerExpr(parenExpr->getSubExpr());
+    } else if (CastExpr* castexpr = dyn_cast<CastExpr>(expr)) {
+      if (castexpr->getCastKind() == CK_FunctionToPointerDecay) {
+        fail(expr);
+        return zero;
+      }
+      llvm::Value* val = lowerExpr(castexpr->getSubExpr());
+      int access;
+      switch (getCastConversion(mContext, castexpr, access)) {
+        case CastTruncate: {
+          llvm::Type* narrow = B.getIntNTy(8 * (access < 0 ? -access : access));
+          val = B.CreateTrunc(val, narrow);
+          return access < 0 ? B.CreateZExt(val, i32) : B.CreateSExt(val, i32);
+        }
+        case CastToBool:
+          return B.CreateZExt(toBool(val), i32);
+        default:
+          return val;
+      }
+    } else if (DeclRefExpr* declref = dyn_cast<DeclRefExpr>(expr)) {
+      llvm::Value* addr = lowerVarAddr(declref);
+      return addr ? B.CreateLoad(i32, addr) : zero;
+    } else if (BinaryOperator* bop = dyn_cast<BinaryOperator>(expr)) {
+      return lowerBinop(bop);
+    } else if (UnaryOperator* unaryOperator = dyn_cast<UnaryOperator>(expr)) {
+      llvm::Value* val = lowerExpr(unaryOperator->getSubExpr());
+      switch (unaryOperator->getOpcode()) {
+        case UO_Plus:
+          return val;
+        case UO_Minus:
+          return B.CreateNeg(val);
+        case UO_LNot:
+          return B.CreateZExt(B.CreateICmpEQ(val, zero), i32);
+        case UO_Deref:
+          return heapGet(val, expr->getType());
+        default:
+          fail(expr);
+          return zero;
+      }
+    } else if (CallExpr* callexpr = dyn_cast<CallExpr>(expr)) {
+      return lowerCall(callexpr);
+    } else if (ArraySubscriptExpr* arraySubscriptExpr =
+                   dyn_cast<ArraySubscriptExpr>(expr)) {
+      llvm::Value* addr = lowerSubscriptAddr(arraySubscriptExpr);
+      if (!isLoadedElement(expr->getType())) return addr;
+      return heapGet(addr, expr->getType());
+    } else if (ConditionalOperator* condOperator =
+                   dyn_cast<ConditionalOperator>(expr)) {
+      llvm::BasicBlock* trueBB = newBlock("cond.true");
+      llvm::BasicBlock* falseBB = newBlock("cond.false");
+      llvm::BasicBlock* endBB = newBlock("cond.end");
+      B.CreateCondBr(toBool(lowerExpr(condOperator->getCond())), trueBB,
+                     falseBB);
+      B.SetInsertPoint(trueBB);
+      llvm::Value* trueVal = lowerExpr(condOperator->getTrueExpr());
+      llvm::BasicBlock* trueEnd = B.GetInsertBlock();
+      B.CreateBr(endBB);
+      B.SetInsertPoint(falseBB);
+      llvm::Value* falseVal = lowerExpr(condOperator->getFalseExpr());
+      llvm::BasicBlock* falseEnd = B.GetInsertBlock();
+      B.CreateBr(endBB);
+      B.SetInsertPoint(endBB);
+      llvm::PHINode* phi = B.CreatePHI(i32, 2);
+      phi->addIncoming(trueVal, trueEnd);
+      phi->addIncoming(falseVal, falseEnd);
+      return phi;
+    } else if (isa<UnaryExprOrTypeTraitExpr>(expr)) {
+      return llvm::ConstantInt::get(i32, sizeof(int));
+    }
+    fail(expr);
+    return zero;
+  }
+
+  /// Address of a local slot or of a global in the interpreter's globals
+  llvm::Value* lowerVarAddr(DeclRefExpr* declref) {
+    VarSlot slot;
+    if (!mLayout.lookup(declref->getDecl(), slot)) {
+      fail(declref);
+      return NULL;
+    }
+    if (slot.isGlobal) return B.CreateConstGEP1_32(i32, mGlobals, slot.index);
+    return mSlots[slot.index];
+  }
+
+  llvm::Value* lowerBinop(BinaryOperator* bop) {
+    llvm::Value* zero = llvm::ConstantInt::get(i32, 0);
+    if (bop->isAssignmentOp()) {
+      if (bop->isCompoundAssignmentOp()) {
+        fail(bop);
+        return zero;
+      }
+      Expr* left = bop->getLHS()->IgnoreParens();
+      if (DeclRefExpr* declexpr = dyn_cast<DeclRefExpr>(left)) {
+        llvm::Value* addr = lowerVarAddr(declexpr);
+        llvm::Value* val = lowerExpr(bop->getRHS());
+        if (addr) B.CreateStore(val, addr);
+        return val;
+      }
+      llvm::Value* addr;
+      UnaryOperator* unaryOperator = dyn_cast<UnaryOperator>(left);
+      if (unaryOperator && unaryOperator->getOpcode() == UO_Deref) {
+        addr = lowerExpr(unaryOperator->getSubExpr());
+      } else if (ArraySubscriptExpr* arraySubscriptExpr =
+                     dyn_cast<ArraySubscriptExpr>(left)) {
+        addr = lowerSubscriptAddr(arraySubscriptExpr);
+      } else {
+        fail(bop);
+        return zero;
+      }
+      llvm::Value* val = lowerExpr(bop->getRHS());
+      llvm::Value* access =
+          llvm::ConstantInt::get(i32, getAccessCode(mContext, left->getType()));
+      B.CreateCall(getRuntime("astinterp_heap_set",
+                              llvm::Type::getVoidTy(C), {i32, i32, i32}),
+                   {mRuntime, addr, access, val});
+      return val;
+    }
+    if (bop->isLogicalOp()) {
+      bool isAnd = bop->getOpcode() == BO_LAnd;
+      llvm::Value* left = toBool(lowerExpr(bop->getLHS()));
+      llvm::BasicBlock* leftEnd = B.GetInsertBlock();
+      llvm::BasicBlock* rightBB = newBlock("logic.rhs");
+      llvm::BasicBlock* endBB = newBlock("logic.end");
+      if (isAnd)
+        B.CreateCondBr(left, rightBB, endBB);
+      else
+        B.CreateCondBr(left, endBB, rightBB);
+      B.SetInsertPoint(rightBB);
+      llvm::Value* right = toBool(lowerExpr(bop->getRHS()));
+      llvm::BasicBlock* rightEnd = B.GetInsertBlock();
+      B.CreateBr(endBB);
+      B.SetInsertPoint(endBB);
+      llvm::PHINode* phi = B.CreatePHI(B.getInt1Ty(), 2);
+      phi->addIncoming(B.getInt1(!isAnd), leftEnd);
+      phi->addIncoming(right, rightEnd);
+      return B.CreateZExt(phi, i32);
+    }
+    if (bop->getOpcode() == BO_Comma) {
+      lowerExpr(bop->getLHS());
+      return lowerExpr(bop->getRHS());
+    }
+    llvm::Value* left = lowerExpr(bop->getLHS());
+    llvm::Value* right = lowerExpr(bop->getRHS());
+    PointerArith arith = getPointerArith(mContext, bop);
+    left = scale(left, arith.leftScale);
+    right = scale(right, arith.rightScale);
+    if (arith.divisor != 1) {
+      llvm::Value* size = llvm::ConstantInt::get(i32, arith.divisor);
+      return B.CreateSDiv(B.CreateSub(left, right), size);
+    }
+    switch (bop->getOpcode()) {
+      case BO_Add:
+        return B.CreateAdd(left, right);
+      case BO_Sub:
+        return B.CreateSub(left, right);
+      case BO_Mul:
+        return B.CreateMul(left, right);
+      case BO_Div:
+        guardDivision(left, right);
+        return B.CreateSDiv(left, right);
+      case BO_Rem:
+        guardDivision(left, right);
+        return B.CreateSRem(left, right);
+      case BO_LT:
+        return B.CreateZExt(B.CreateICmpSLT(left, right), i32);
+      case BO_GT:
+        return B.CreateZExt(B.CreateICmpSGT(left, right), i32);
+      case BO_LE:
+        return B.CreateZExt(B.CreateICmpSLE(left, right), i32);
+      case BO_GE:
+        return B.CreateZExt(B.CreateICmpSGE(left, right), i32);
+      case BO_EQ:
+        return B.CreateZExt(B.CreateICmpEQ(left, right), i32);
+      case BO_NE:
+        return B.CreateZExt(B.CreateICmpNE(left, right), i32);
+      default:
+        fail(bop);
+        return zero;
+    }
+  }
+
+  llvm::Value* lowerCall(CallExpr* callexpr) {
+    llvm::Value* zero = llvm::ConstantInt::get(i32, 0);
+    FunctionDecl* callee = callexpr->getDirectCallee();
+    if (!callee) {
+      fail(callexpr);
+      return zero;
+    }
+    llvm::Type* voidTy = llvm::Type::getVoidTy(C);
+    if (callee == mInput) {
+      return B.CreateCall(getRuntime("astinterp_get", i32, {}), {mRuntime});
+    } else if (callee == mOutput) {
+      llvm::Value* val = lowerExpr(callexpr->getArg(0));
+      B.CreateCall(getRuntime("astinterp_print", voidTy, {i32}),
+                   {mRuntime, val});
+      return val;
+    } else if (callee == mMalloc) {
+      llvm::Value* size = lowerExpr(callexpr->getArg(0));
+      return B.CreateCall(getRuntime("astinterp_malloc", i32, {i32}),
+                          {mRuntime, size});
+    } else if (callee == mFree) {
+      llvm::Value* addr = lowerExpr(callexpr->getArg(0));
+      B.CreateCall(getRuntime("astinterp_free", voidTy, {i32}),
+                   {mRuntime, addr});
+      return addr;
+    }
+    FunctionDecl* definition = callee->getDefinition();
+    if (!definition) {
+      fail(callexpr);
+      return zero;
+    }
+    std::vector<llvm::Value*> args = {mRuntime, mGlobals};
+    for (unsigned i = 0; i < callexpr->getNumArgs(); i++) {
+      args.push_back(lowerExpr(callexpr->getArg(i)));
+    }
+    return B.CreateCall(getFunction(definition), args);
+  }
+
+  llvm::Value* lowerSubscriptAddr(ArraySubscriptExpr* arraySubscriptExpr) {
+    llvm::Value* base = lowerExpr(arraySubscriptExpr->getBase());
+    llvm::Value* idx = lowerExpr(arraySubscriptExpr->getIdx());
+    idx = scale(idx, getElementSize(mContext, arraySubscriptExpr));
+    return B.CreateAdd(base, idx);
+  }
+
+  /// val times size, for subscripts and pointer arithmetic
+  llvm::Value* scale(llvm::Value* val, int size) {
+    if (size == 1) return val;
+    return B.CreateMul(val, llvm::ConstantInt::get(i32, size));
+  }
+
+  llvm::Value* heapGet(llvm::Value* addr, QualType type) {
+    llvm::Value* access =
+        llvm::ConstantInt::get(i32, getAccessCode(mContext, type));
+    return B.CreateCall(getRuntime("astinterp_heap_get", i32, {i32, i32}),
+                        {mRuntime, addr, access});
+  }
+};
+
+}  // namespace
+
+TierUpJIT::TierUpJIT(const ASTContext& context, const SlotLayout& layout,
+                     FunctionDecl* freeDecl, FunctionDecl* mallocDecl,
+                     FunctionDecl* inputDecl, FunctionDecl* outputDecl,
+                     Heap& heap, ProgramIO& io, int* globals,
+                     unsigned threshold)
+    : mContext(context),
+      mLayout(layout),
+      mFree(freeDecl),
+      mMalloc(mallocDecl),
+      mInput(inputDecl),
+      mOutput(outputDecl),
+      mThreshold(threshold),
+      mGlobals(globals) {
+  mRuntime.heap = &heap;
+  mRuntime.io = &io;
+  // Batch jobs create their JITs concurrently, the target registry is
+  // global
+  static std::once_flag targetInitialized;
+  std::call_once(targetInitialized, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit) {
+    llvm::logAllUnhandledErrors(jit.takeError(), llvm::errs(),
+                                "JIT disabled: ");
+    return;
+  }
+  mJIT = std::move(*jit);
+
+  llvm::orc::MangleAndInterner mangle(mJIT->getExecutionSession(),
+                                      mJIT->getDataLayout());
+  llvm::orc::SymbolMap symbols;
+  auto define = [&](const char* name, void* addr) {
+    symbols[mangle(name)] = llvm::JITEvaluatedSymbol(
+        llvm::pointerToJITTargetAddress(addr), llvm::JITSymbolFlags::Exported);
+  };
+  define("astinterp_heap_get", (void*)&astinterp_heap_get);
+  define("astinterp_heap_set", (void*)&astinterp_heap_set);
+  define("astinterp_malloc", (void*)&astinterp_malloc);
+  define("astinterp_free", (void*)&astinterp_free);
+  define("astinterp_alloc_frame", (void*)&astinterp_alloc_frame);
+  define("astinterp_release_frame", (void*)&astinterp_release_frame);
+  define("astinterp_get", (void*)&astinterp_get);
+  define("astinterp_print", (void*)&astinterp_print);
+  define("astinterp_check_division", (void*)&astinterp_check_division);
+  llvm::cantFail(
+      mJIT->getMainJITDylib().define(llvm::orc::absoluteSymbols(symbols)));
+}
+
+TierUpJIT::~TierUpJIT() {}
+
+NativeEntry TierUpJIT::enter(FunctionDecl* fdecl) {
+  if (!mJIT) return NULL;
+  HotFunction& hot = mHot[fdecl];
+  if (hot.entry) return hot.entry;
+  if (hot.failed || ++hot.calls <= mThreshold) return NULL;
+  hot.entry = compile(fdecl, hot.failure);
+  hot.failed = !hot.entry;
+  return hot.entry;
+}
+
+void TierUpJIT::printStats(llvm::raw_ostream& os) const {
+  // Sorted by name, the map is ordered by address
+  std::map<std::string, const HotFunction*> sorted;
+  for (const auto& entry : mHot) {
+    sorted[entry.first->getNameAsString()] = &entry.second;
+  }
+  for (const auto& entry : sorted) {
+    if (entry.second->entry)
+      os << "jit compiled: " << entry.first << "\n";
+    else if (entry.second->failed)
+      os << "jit interpreted: " << entry.first << " ("
+         << entry.second->failure << ")\n";
+  }
+}
+
+NativeEntry TierUpJIT::compile(FunctionDecl* fdecl, std::string& failure) {
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto module = std::make_unique<llvm::Module>(
+      "astinterp." + fdecl->getNameAsString(), *context);
+  module->setDataLayout(mJIT->getDataLayout());
+
+  std::vector<const FunctionDecl*> lowered;
+  IRLowering lowering(mContext, mLayout, mFree, mMalloc, mInput, mOutput,
+                      mLowered, *module);
+  if (!lowering.lower(fdecl, lowered)) {
+    failure = lowering.getFailure();
+    return NULL;
+  }
+
+  llvm::legacy::FunctionPassManager passes(module.get());
+  passes.add(llvm::createPromoteMemoryToRegisterPass());
+  passes.add(llvm::createInstructionCombiningPass());
+  // Brings the index arithmetic of subscripts into one canonical order, so
+  // GVN can share it between the loads and stores of a[i]
+  passes.add(llvm::createReassociatePass());
+  passes.add(llvm::createGVNPass());
+  passes.add(llvm::createCFGSimplificationPass());
+  passes.doInitialization();
+  for (llvm::Function& fn : *module) {
+    if (!fn.isDeclaration()) passes.run(fn);
+  }
+  passes.doFinalization();
+
+  if (llvm::Error err = mJIT->addIRModule(
+          llvm::orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+    llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "JIT: ");
+    failure = "rejected by LLJIT";
+    return NULL;
+  }
+  mLowered.insert(lowered.begin(), lowered.end());
+
+  auto symbol = mJIT->lookup(IRLowering::entryName(fdecl));
+  if (!symbol) {
+    llvm::logAllUnhandledErrors(symbol.takeError(), llvm::errs(), "JIT: ");
+    failure = "entry not found";
+    return NULL;
+  }
+  return reinterpret_cast<NativeEntry>(symbol->getAddress());
+}
+
+#endif
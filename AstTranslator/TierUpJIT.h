@@ -0,0 +1,84 @@
+//==--- TierUpJIT.h - LLVM compilation of hot functions -------------------===//
+#ifndef __TIERUPJIT_H
+#define __TIERUPJIT_H
+#ifdef ENABLE_ORC_JIT
+#include <memory>
+#include <set>
+#include <string>
+
+#include "Heap.h"
+#include "IO.h"
+#include "MemoryAccess.h"
+#include "SlotLayout.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+
+using namespace clang;
+
+/// What native code needs from the interpreter. A pointer to it is passed
+/// as hidden first argument of every lowered function and handed back to
+/// the runtime callbacks.
+struct JITRuntime {
+  Heap* heap;
+  ProgramIO* io;
+};
+
+/// Native entry of a lowered function: runtime, globals, arguments
+typedef int (*NativeEntry)(JITRuntime*, int*, const int*);
+
+/// Counts the calls Environment::call makes to each function definition.
+/// Once a function has been called more than the threshold it is lowered
+/// from its Clang AST to LLVM IR together with every user function it can
+/// reach, compiled with ORC LLJIT, and called natively from then on.
+/// Functions that use a construct the lowering does not know keep running
+/// in the interpreter.
+class TierUpJIT {
+  struct HotFunction {
+    unsigned calls;
+    bool failed;
+    NativeEntry entry;
+    /// Why the function stays interpreted, when it failed
+    std::string failure;
+    HotFunction() : calls(0), failed(false), entry(NULL) {}
+  };
+
+  const ASTContext& mContext;
+  const SlotLayout& mLayout;
+  FunctionDecl* mFree;
+  FunctionDecl* mMalloc;
+  FunctionDecl* mInput;
+  FunctionDecl* mOutput;
+  unsigned mThreshold;
+
+  JITRuntime mRuntime;
+  int* mGlobals;
+  std::unique_ptr<llvm::orc::LLJIT> mJIT;
+  llvm::DenseMap<const FunctionDecl*, HotFunction> mHot;
+  /// Functions whose code already lives in the JIT
+  std::set<const FunctionDecl*> mLowered;
+
+ public:
+  TierUpJIT(const ASTContext& context, const SlotLayout& layout,
+            FunctionDecl* freeDecl, FunctionDecl* mallocDecl,
+            FunctionDecl* inputDecl, FunctionDecl* outputDecl, Heap& heap,
+            ProgramIO& io, int* globals, unsigned threshold);
+  ~TierUpJIT();
+
+  /// Count one call of the definition fdecl and return its native entry
+  /// when it has become hot and could be compiled, NULL otherwise.
+  NativeEntry enter(FunctionDecl* fdecl);
+  int invoke(NativeEntry entry, const int* args) {
+    return entry(&mRuntime, mGlobals, args);
+  }
+  /// List the hot functions that were compiled and why the others were not
+  void printStats(llvm::raw_ostream& os) const;
+
+ private:
+  /// Compile fdecl, or return NULL and describe the reason in failure
+  NativeEntry compile(FunctionDecl* fdecl, std::string& failure);
+};
+
+#endif
+#endif
@@ -0,0 +1,22 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int i;
+   int j;
+   int n;
+   int sum = 0;
+   int *a;
+   n = GET();
+   for (i = 0; i < n; i = i + 1) {
+      a = (int *)MALLOC(sizeof(int) * 64);
+      for (j = 0; j < 64; j = j + 1) {
+         a[j] = i - j;
+      }
+      sum = sum + a[i / 100 % 64] / 10;
+      FREE(a);
+   }
+   PRINT(sum);
+}
@@ -0,0 +1,25 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int *a;
+   int n;
+   int i;
+   int round;
+   int sum = 0;
+   n = GET();
+   a = (int *)MALLOC(sizeof(int) * n);
+   for (i = 0; i < n; i = i + 1) {
+      a[i] = i / 3 - 100;
+   }
+   for (round = 0; round < 50; round = round + 1) {
+      for (i = 1; i < n; i = i + 1) {
+         if (a[i - 1] > a[i]) sum = sum + 1;
+         else sum = sum + a[i] / 100;
+      }
+   }
+   PRINT(sum);
+   FREE(a);
+}
@@ -0,0 +1,15 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int fib(int n) {
+   if (n < 2) return n;
+   return fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+   int n;
+   n = GET();
+   PRINT(fib(n));
+}
@@ -0,0 +1,34 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+/* Follow a scrambled successor list; n should be prime */
+int main() {
+   int n;
+   int steps;
+   int i;
+   int t;
+   int p = 0;
+   int sum = 0;
+   int *next;
+   int *vals;
+   int *node;
+   n = GET();
+   steps = GET();
+   next = (int *)MALLOC(sizeof(int) * n);
+   vals = (int *)MALLOC(sizeof(int) * n);
+   for (i = 0; i < n; i = i + 1) {
+      t = i * 37 + 11;
+      next[i] = t - t / n * n;
+      vals[i] = i / 7 - 50;
+   }
+   for (i = 0; i < steps; i = i + 1) {
+      node = vals + p;
+      sum = sum + *node;
+      p = next[p];
+   }
+   PRINT(sum);
+   FREE(next);
+   FREE(vals);
+}
@@ -0,0 +1,42 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int n;
+   int i;
+   int j;
+   int k;
+   int s;
+   int sum = 0;
+   int *a;
+   int *b;
+   int *c;
+   n = GET();
+   a = (int *)MALLOC(sizeof(int) * n * n);
+   b = (int *)MALLOC(sizeof(int) * n * n);
+   c = (int *)MALLOC(sizeof(int) * n * n);
+   for (i = 0; i < n; i = i + 1) {
+      for (j = 0; j < n; j = j + 1) {
+         a[i * n + j] = i - j;
+         b[i * n + j] = i + j / 2;
+      }
+   }
+   for (i = 0; i < n; i = i + 1) {
+      for (j = 0; j < n; j = j + 1) {
+         s = 0;
+         for (k = 0; k < n; k = k + 1) {
+            s = s + a[i * n + k] * b[k * n + j];
+         }
+         c[i * n + j] = s;
+      }
+   }
+   for (i = 0; i < n; i = i + 1) {
+      sum = sum + c[i * n + n - 1 - i] / 8;
+   }
+   PRINT(sum);
+   FREE(a);
+   FREE(b);
+   FREE(c);
+}
@@ -0,0 +1,18 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int i;
+   int j;
+   int n;
+   int sum = 0;
+   n = GET();
+   for (i = 0; i < n; i = i + 1) {
+      for (j = 0; j < 300; j = j + 1) {
+         sum = sum + (i + j * 2) / 7 - j / 5;
+      }
+   }
+   PRINT(sum);
+}
@@ -0,0 +1,21 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int a = 0;
+   int c = 0;
+   int n;
+   n = GET();
+   while (a < n) {
+      int b = 0;
+      a = a + 1;
+      while (b < 200) {
+         b = b + 1;
+         if (b > 100) c = c + 2;
+         else c = c - 1;
+      }
+   }
+   PRINT(c);
+}
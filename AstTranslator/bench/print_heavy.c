@@ -0,0 +1,13 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int n;
+   int i;
+   n = GET();
+   for (i = 0; i < n; i = i + 1) {
+      PRINT(i * 7 - 3);
+   }
+}
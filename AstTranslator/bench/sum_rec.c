@@ -0,0 +1,20 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int sum(int n) {
+   if (n == 0) return 0;
+   return (n + sum(n - 1)) % 1000003;
+}
+
+int main() {
+   int n;
+   int runs;
+   int i;
+   n = GET();
+   runs = GET();
+   for (i = 0; i < runs; i = i + 1) {
+      PRINT(sum(n));
+   }
+}
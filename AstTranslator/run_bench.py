@@ -0,0 +1,112 @@
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+def read_input(file: str, scale: float) -> str:
+    """The program's GET() input: <name>.in next to it, first value scaled."""
+    input_file = file[:-2] + ".in"
+    if not os.path.exists(input_file):
+        return ""
+    with open(input_file, "r") as f:
+        values = f.read().split()
+    if values and scale != 1.0:
+        values[0] = str(max(1, int(int(values[0]) * scale)))
+    return " ".join(values) + "\n"
+
+def read_instructions(perf_file: str):
+    with open(perf_file, "r") as f:
+        for line in f:
+            fields = line.strip().split(",")
+            if len(fields) > 2 and fields[2].startswith("instructions"):
+                try:
+                    return int(fields[0])
+                except ValueError:
+                    return None
+    return None
+
+def run_once(interpreter: str, interp_args: str, file: str, stdin: str, perf: bool):
+    with open(file, "r") as f:
+        code = f.read()
+    cmd = [interpreter] + interp_args.split() + [code]
+    perf_file = None
+    if perf:
+        fd, perf_file = tempfile.mkstemp(suffix=".perf")
+        os.close(fd)
+        cmd = ["perf", "stat", "-x,", "-e", "instructions", "-o", perf_file, "--"] + cmd
+    with tempfile.TemporaryFile() as stdin_f, tempfile.TemporaryFile() as stderr_f:
+        stdin_f.write(stdin.encode())
+        stdin_f.seek(0)
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd, stdin=stdin_f, stdout=subprocess.DEVNULL, stderr=stderr_f)
+        _, status, usage = os.wait4(proc.pid, 0)
+        elapsed = time.perf_counter() - start
+        proc.returncode = os.waitstatus_to_exitcode(status)
+        stderr_f.seek(0)
+        output = stderr_f.read().decode()
+    instructions = None
+    if perf_file:
+        instructions = read_instructions(perf_file)
+        os.remove(perf_file)
+    if proc.returncode != 0:
+        sys.stderr.write("cmd: %s %s %s Error!\nReturn with Code %s\n" % (interpreter, interp_args, file, proc.returncode))
+        sys.exit(-1)
+    # ru_maxrss is in KiB on Linux
+    return elapsed, instructions, usage.ru_maxrss, output
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-i", type=str, default="bench")
+parser.add_argument("-interp", type=str, default="build/ast-interpreter")
+parser.add_argument("-runs", type=int, default=3)
+parser.add_argument("-scale", type=float, default=1.0,
+                    help="multiply the size each program reads first from its .in file")
+parser.add_argument("-perf", type=str, choices=["auto", "on", "off"], default="auto",
+                    help="count native instructions with perf stat")
+parser.add_argument("-csv", type=str, default="",
+                    help="also write the results to this csv file")
+# One string, or argparse would take the leading "--" of the interpreter
+# flags for options of its own: -configs="--fold-cache=false,--fold-cache=true"
+parser.add_argument("-configs", type=str, default="--fold-cache=false,--fold-cache=true",
+                    help="comma separated interpreter argument lists to compare")
+args = parser.parse_args()
+configs = args.configs.split(",")
+bench_dir = os.path.abspath(args.i)
+interp = os.path.abspath(args.interp)
+perf = args.perf == "on" or (args.perf == "auto" and shutil.which("perf") is not None)
+
+rows = []
+print("%-20s %-30s %10s %9s %12s %10s" % ("program", "args", "best(s)", "speedup", "Minstr/s", "rss(KiB)"))
+for file_name in sorted(os.listdir(bench_dir)):
+    file = os.path.join(bench_dir, file_name)
+    if not file.endswith(".c"):
+        continue
+    stdin = read_input(file, args.scale)
+    baseline = None
+    baseline_output = None
+    for config in configs:
+        best = None
+        best_ips = None
+        peak_rss = 0
+        for _ in range(args.runs):
+            elapsed, instructions, rss, output = run_once(interp, config, file, stdin, perf)
+            if best is None or elapsed < best:
+                best = elapsed
+                best_ips = instructions / elapsed if instructions else None
+            peak_rss = max(peak_rss, rss)
+        if baseline is None:
+            baseline = best
+            baseline_output = output
+        elif output != baseline_output:
+            print("\033[31mOutput mismatch: %s %s\033[0m" % (file_name, config))
+        ips = "%12.1f" % (best_ips / 1e6) if best_ips else "%12s" % "-"
+        print("%-20s %-30s %10.3f %8.2fx %s %10d" % (file_name, config, best, baseline / best, ips, peak_rss))
+        rows.append((file_name, config, best, baseline / best, best_ips or 0, peak_rss))
+
+if args.csv:
+    with open(args.csv, "w") as f:
+        f.write("program,args,best_s,speedup,instructions_per_s,peak_rss_kib\n")
+        for row in rows:
+            f.write("%s,%s,%.6f,%.4f,%.0f,%d\n" % row)
@@ -2,6 +2,7 @@ import argparse
 import os
 import sys
 import subprocess
+import tempfile
 
 def copyCFile(from_file: str, to_file: str):
     INCLUDE_str = """#include <stdio.h>\n#include <stdlib.h>\n"""
@@ -25,7 +26,7 @@ def copyCFile(from_file: str, to_file: str):
     with open(to_file, "w") as to_f:
         to_f.writelines(to_lines)
 
-def get_std_result(file: str) -> str:
+def get_std_result(file: str, stdin: str) -> str:
     binary = file + ".out"
     compile_cmd = "gcc %s -o %s" % (file, binary)
     compile_result = subprocess.run(compile_cmd, shell=True, capture_output=True, text=True)
@@ -34,25 +35,61 @@ def get_std_result(file: str) -> str:
         sys.stderr.write("cmd: %s Error!\nReturn with Code %d\n" % (compile_cmd, return_code))
         sys.exit(-1)
     
-    exec_result = subprocess.run(binary, shell=True, capture_output=True, text=True)
+    exec_result = subprocess.run(binary, shell=True, input=stdin, capture_output=True, text=True)
     stderr_output = exec_result.stderr
     return stderr_output
 
-def get_interpreter_result(file: str, interpreter: str) -> str:
-    interpreter_cmd = """%s "$(cat %s)" """ % (interpreter, file)
-    interpreter_result = subprocess.run(interpreter_cmd, shell=True, capture_output=True, text=True)
+def get_directives(file: str, name: str) -> list:
+    prefix = "// %s:" % name
+    directives = list()
+    with open(file, "r") as f:
+        for line in f:
+            if not line.startswith(prefix):
+                continue
+            directive = line[len(prefix):].strip()
+            # A trailing backslash continues the directive on the next one
+            if directives and directives[-1].endswith("\\"):
+                directives[-1] = directives[-1][:-1] + directive
+            else:
+                directives.append(directive)
+    return directives
+
+def get_input(file: str) -> str:
+    return "".join(line + "\n" for line in get_directives(file, "INPUT"))
+
+def run_interpreter(interpreter_cmd: str, error: str, stdin: str) -> str:
+    interpreter_result = subprocess.run(interpreter_cmd, shell=True, input=stdin, capture_output=True, text=True)
     return_code = interpreter_result.returncode
-    if return_code != 0:
-        sys.stderr.write("cmd: %s Error!\nReturn with Code %s\n" % (interpreter_cmd, return_code))
+    if (return_code != 0) != bool(error):
+        sys.stderr.write("cmd: %s Error!\nReturn with Code %s\n%s" % (interpreter_cmd, return_code, interpreter_result.stderr))
         sys.exit(-1)
     
     stderr_output = interpreter_result.stderr
     return stderr_output
 
+# A test may replace the plain run by "// RUN: <shell command>" lines, where
+# %interp is the interpreter, %s the test and %t a scratch directory shared
+# by the test's commands; each one's stderr must match the native output. "// ERROR: <message>" expects
+# the interpreter to fail and print the message after that output. "// INPUT: <text>" lines are the
+# stdin of the native run and of every interpreter run.
+def get_interpreter_results(file: str, interpreter: str, interp_args: str) -> list:
+    runs = get_directives(file, "RUN")
+    if not runs:
+        runs = ["""%%interp %s "$(cat %%s)" """ % interp_args]
+    error = "\n".join(get_directives(file, "ERROR"))
+    stdin = get_input(file)
+    results = list()
+    with tempfile.TemporaryDirectory() as scratch:
+        for run in runs:
+            interpreter_cmd = run.replace("%interp", interpreter).replace("%s", file).replace("%t", scratch)
+            results.append(run_interpreter(interpreter_cmd, error, stdin))
+    return results
+
 parser = argparse.ArgumentParser()
 parser.add_argument("-i", type=str, default="tests")
 parser.add_argument("-o", type=str, default="tests-std-c")
 parser.add_argument("-interp", type=str, default="build/ast-interpreter")
+parser.add_argument("-args", type=str, default="")
 args = parser.parse_args()
 test_dir = os.path.abspath(args.i)
 test_std_c_dir = os.path.join(test_dir, args.o)
@@ -71,8 +108,12 @@ for file_name in os.listdir(test_dir):
     file_std_c = os.path.join(test_std_c_dir, file_name)
     copyCFile(file, file_std_c)
     
-    std_c_result = get_std_result(file_std_c)
-    interpreter_result = get_interpreter_result(file, interp)
+    std_c_result = get_std_result(file_std_c, get_input(file))
+    error = get_directives(file, "ERROR")
+    if error:
+        std_c_result += "\n".join(error) + "\n"
+    interpreter_results = get_interpreter_results(file, interp, args.args)
+    interpreter_result = next((result for result in interpreter_results if result != std_c_result), std_c_result)
 
     if std_c_result == interpreter_result:
         print("\033[32mTest Passed: %s\033[0m" % file)
@@ -0,0 +1,23 @@
+// The two broken jobs fail on their own, the last one still runs
+// RUN: echo 'int f(); int main() { return f(); }' > %t/undefined.c; \
+// RUN: printf 'undefined.c\nmissing.c\n%s %t/in %t/out\n' > %t/jobs; \
+// RUN: : > %t/in; %interp --batch=%t/jobs --jobs=2 > %t/report; \
+// RUN: test $? = 1 && test $(grep -c '^error: ' %t/report) = 2 && \
+// RUN: cat %t/out >&2
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int square(int n) {
+   return n * n;
+}
+
+int main() {
+   int i;
+   int sum = 0;
+   for (i = 0; i < 10; i = i + 1) {
+      sum = sum + square(i);
+      PRINT(sum);
+   }
+}
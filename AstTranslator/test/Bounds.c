@@ -0,0 +1,20 @@
+// ERROR: Heap access out of bounds at address -399999992
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int *p;
+   int *q;
+   p = (int *)MALLOC(4 * sizeof(int));
+   p[3] = 3;
+   PRINT(p[3]);
+   FREE(0);
+   q = (int *)MALLOC(sizeof(int));
+   q[0] = 4;
+   PRINT(q[0]);
+   FREE(q);
+   p[0 - 100000000] = 5;
+   PRINT(p[0]);
+}
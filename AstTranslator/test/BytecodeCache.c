@@ -0,0 +1,36 @@
+// A warm run skips the compiler
+// RUN: %interp --engine=vm --bytecode-cache=%t "$(cat %s)" 2> /dev/null && \
+// RUN: %interp --engine=vm --bytecode-cache=%t --time-phases "$(cat %s)" \
+// RUN:   > %t/phases && ! grep -q '^compile' %t/phases
+// A changed source misses
+// RUN: %interp --engine=vm --bytecode-cache=%t --time-phases \
+// RUN:   "$(cat %s; echo '// changed')" > %t/phases && \
+// RUN: grep -q '^compile' %t/phases
+// An entry that no longer ends in a return fails verification and is
+// compiled again
+// RUN: for f in %t/*.bc; do python3 -c "import sys; \
+// RUN: d = bytearray(open(sys.argv[1], 'rb').read()); d[-16] = 1; \
+// RUN: open(sys.argv[1], 'wb').write(d)" "$f"; done && \
+// RUN: %interp --engine=vm --bytecode-cache=%t --time-phases "$(cat %s)" \
+// RUN:   > %t/phases && grep -q '^compile' %t/phases
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int total = 7;
+
+int fib(int n) {
+   if (n < 2) {
+      return n;
+   }
+   return fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+   int i;
+   for (i = 0; i < 12; i = i + 1) {
+      total = total + fib(i);
+      PRINT(total);
+   }
+}
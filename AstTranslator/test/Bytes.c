@@ -0,0 +1,34 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   char buf[16];
+   int *a;
+   int *p;
+   int **rows;
+   int i;
+   int sum = 0;
+   for (i = 0; i < 16; i = i + 1) {
+      buf[i] = i * 20;
+   }
+   for (i = 0; i < 16; i = i + 1) {
+      sum = sum + buf[i];
+   }
+   PRINT(sum);
+   a = (int *)MALLOC(sizeof(int) * 8);
+   for (i = 0; i < 8; i = i + 1) {
+      a[i] = i * i;
+   }
+   p = a + 3;
+   PRINT(*p);
+   PRINT(*(p + 2));
+   PRINT(p - a);
+   rows = (int **)MALLOC(sizeof(int *) * 2);
+   rows[0] = a;
+   rows[1] = a + 4;
+   PRINT(rows[1][1]);
+   FREE(rows);
+   FREE(a);
+}
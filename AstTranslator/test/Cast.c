@@ -0,0 +1,36 @@
+// RUN: %interp "$(cat %s)"
+// RUN: %interp --engine=vm "$(cat %s)"
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int narrow(int n) {
+   char c = n;
+   return c;
+}
+
+int main() {
+   int big = 300;
+   int i;
+   char c = big;
+   unsigned char u;
+   short s;
+   PRINT(c);
+   c = 300;
+   PRINT(c);
+   u = big + 200;
+   PRINT(u);
+   s = big * 200;
+   PRINT(s);
+   PRINT((char)(big - 172));
+   PRINT((unsigned char)(0 - big));
+   PRINT(narrow(1000));
+   for (i = 250; i < 260; i = i + 1) {
+      PRINT(narrow(i) < 0);
+   }
+   PRINT(!big);
+   PRINT(!!big);
+   PRINT(big && 2);
+   PRINT(big ? 5 : 6);
+}
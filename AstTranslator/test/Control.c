@@ -0,0 +1,36 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int find(int *a, int n, int v) {
+   int i;
+   for (i = 0; i < n; i = i + 1) {
+      if (a[i] == v) return i;
+   }
+   return -1;
+}
+
+int main() {
+   int *a;
+   int i;
+   int j;
+   int sum = 0;
+   a = (int *)MALLOC(sizeof(int) * 10);
+   for (i = 0; i < 10; i = i + 1) {
+      a[i] = i * 3;
+   }
+   PRINT(find(a, 10, 12));
+   PRINT(find(a, 10, 13));
+   for (i = 0; i < 5; i = i + 1) {
+      j = 0;
+      while (1) {
+         j = j + 1;
+         if (j < 3) continue;
+         if (j > i) break;
+         sum = sum + j;
+      }
+   }
+   PRINT(sum);
+   FREE(a);
+}
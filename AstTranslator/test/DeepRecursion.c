@@ -0,0 +1,17 @@
+// 100000 nested calls, and the error once they exceed the stack budget
+// RUN: %interp --engine=vm "$(cat %s)"
+// RUN: ! %interp --engine=vm --stack-budget=1 "$(cat %s)" 2> %t/err && \
+// RUN: grep -q '^Stack overflow' %t/err && %interp "$(cat %s)"
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int depth(int n) {
+   if (n == 0) return 0;
+   return 1 + depth(n - 1);
+}
+
+int main() {
+   PRINT(depth(100000));
+}
@@ -0,0 +1,19 @@
+// RUN: %interp "$(cat %s)"
+// RUN: %interp --engine=vm "$(cat %s)"
+// ERROR: Division by zero
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int divide(int a, int b) {
+   return a / b;
+}
+
+int main() {
+   int i;
+   for (i = 3; i >= 0; i = i - 1) {
+      PRINT(divide(12, i));
+      PRINT(divide(12, i) % 5);
+   }
+}
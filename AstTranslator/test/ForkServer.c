@@ -0,0 +1,19 @@
+// Every request starts from the state after the global initializers, not
+// from what the previous request left behind
+// INPUT: 5
+// RUN: echo 5 > %t/a.in; echo 5 > %t/b.in; \
+// RUN: printf '%t/a.in\n%t/b.in %t/b.out\n' | \
+// RUN: %interp --fork-server "$(cat %s)" > %t/status && \
+// RUN: test $(grep -c '\.in 0 ' %t/status) = 2 && \
+// RUN: cmp %t/a.in.out %t/b.out && cat %t/b.out >&2
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int counter = 10;
+
+int main() {
+   counter = counter + GET();
+   PRINT(counter);
+}
@@ -0,0 +1,39 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int fill(int n) {
+   int buf[1000];
+   int i;
+   int sum = 0;
+   for (i = 0; i < 1000; i = i + 1) {
+      buf[i] = n + i;
+   }
+   for (i = 0; i < 1000; i = i + 1) {
+      sum = sum + buf[i];
+   }
+   return sum;
+}
+
+int depth(int n) {
+   int a[4];
+   int b[2];
+   a[3] = n;
+   b[0] = n * 2;
+   if (n > 0) {
+      depth(n - 1);
+   }
+   PRINT(a[3] + b[0]);
+   return 0;
+}
+
+int main() {
+   int i;
+   int total = 0;
+   for (i = 0; i < 2000; i = i + 1) {
+      total = (total + fill(i)) % 99991;
+   }
+   PRINT(total);
+   depth(3);
+}
@@ -0,0 +1,27 @@
+// GET and PRINT through their buffers, to stderr, stdout and a file
+// INPUT: 4 -17 +42
+// INPUT: 2147483647    9
+// RUN: %interp "$(cat %s)"
+// RUN: %interp --engine=vm "$(cat %s)"
+// RUN: %interp --print-to=stdout "$(cat %s)" 1>&2
+// RUN: %interp --print-to=%t/out "$(cat %s)" && cat %t/out >&2
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int n;
+   int i;
+   int sum = 0;
+   n = GET();
+   for (i = 0; i < n; i = i + 1) {
+      int val = GET();
+      PRINT(val);
+      sum = sum + val % 1000;
+   }
+   // More output than one buffer holds
+   for (i = 0; i < 20000; i = i + 1) {
+      PRINT(i * 7919 + sum);
+   }
+}
@@ -0,0 +1,27 @@
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int calls;
+
+int touch(int v) {
+   calls = calls + 1;
+   PRINT(v);
+   return v;
+}
+
+int main() {
+   int a;
+   int b;
+   calls = 0;
+   a = 0;
+   b = 3;
+   if (a && touch(1)) PRINT(10);
+   if (b || touch(2)) PRINT(20);
+   if (b && touch(3)) PRINT(30);
+   if (a || touch(0)) PRINT(40);
+   a = b > 2 ? touch(5) : touch(6);
+   PRINT(a);
+   PRINT(calls);
+}
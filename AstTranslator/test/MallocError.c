@@ -0,0 +1,14 @@
+// ERROR: MALLOC of a negative size -4
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int n = 4;
+   int *p;
+   PRINT(n);
+   p = (int *)MALLOC(n - 8);
+   p[0] = n;
+   PRINT(p[0]);
+}
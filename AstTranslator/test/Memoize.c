@@ -0,0 +1,34 @@
+// Only calls of pure functions are served from the memo cache
+// RUN: %interp --memoize "$(cat %s)"
+// RUN: %interp --memoize --profile "$(cat %s)" > %t/report && \
+// RUN: grep -q '^memo hits: [1-9]' %t/report
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int calls = 0;
+
+int fib(int n) {
+   if (n < 2) return n;
+   return fib(n - 1) + fib(n - 2);
+}
+
+int tick(int n) {
+   calls = calls + 1;
+   return n + calls;
+}
+
+int scaled(int n) {
+   return n * calls;
+}
+
+int main() {
+   PRINT(fib(24));
+   PRINT(fib(24));
+   PRINT(tick(1));
+   PRINT(tick(1));
+   PRINT(scaled(2));
+   calls = 5;
+   PRINT(scaled(2));
+}
@@ -0,0 +1,19 @@
+// Output still buffered when the program fails is written before the error
+// RUN: %interp "$(cat %s)"
+// RUN: %interp --engine=vm "$(cat %s)"
+// RUN: %interp --print-to=%t/out "$(cat %s)" 2> %t/err; status=$?; \
+// RUN: cat %t/out %t/err >&2; exit $status
+// ERROR: Division by zero
+extern int GET();
+extern void * MALLOC(int);
+extern void FREE(void *);
+extern void PRINT(int);
+
+int main() {
+   int i;
+   int zero = 0;
+   for (i = 0; i < 20000; i = i + 1) {
+      PRINT(i * 7919);
+   }
+   PRINT(i / zero);
+}